@@ -2,6 +2,7 @@
 
 #include "common.h"
 
+#include <stdio.h> // perror
 #include <stdlib.h> // malloc & pals
 #include <string.h> // memcpy
 
@@ -39,11 +40,14 @@ ArrayRealloc(VoidArray& a, size_t newCapInBytes)
 inline void
 EnsureAddedRoomGrow(VoidArray& a, uint additionalTs, uint sizeOfT) 
 {
-    uint const oldCountTs =  uint(static_cast<char *>(a.pEnd) - static_cast<char *>(a.pBegin));
-    uint const oldCapBytes = uint(static_cast<char *>(a.pCap) - static_cast<char *>(a.pBegin));
-    uint const minCapBytes = oldCountTs + additionalTs * sizeOfT;
-    if (oldCapBytes < minCapBytes) {
-        ArrayRealloc(a, Max<uint>(minCapBytes, ((oldCountTs * 3) / 2u) * sizeOfT));
+    uint const oldCountTs = uint(static_cast<char *>(a.pEnd) - static_cast<char *>(a.pBegin)) / sizeOfT;
+    uint const oldCapTs = uint(static_cast<char *>(a.pCap) - static_cast<char *>(a.pBegin)) / sizeOfT;
+    uint const minCapTs = oldCountTs + additionalTs;
+    if (oldCapTs < minCapTs) {
+        // in elements, 1.5x, so never more than twice what's asked for:
+        uint const newCapTs = Max<uint>(minCapTs, oldCountTs + oldCountTs / 2u);
+        ASSERT(newCapTs <= 2u * minCapTs);
+        ArrayRealloc(a, size_t(newCapTs) * sizeOfT);
     }
 }
 
@@ -72,6 +76,7 @@ public:
     T *begin() const { return BEGIN; }
     T *end() const { return END; }
     uint size() const { return uint(END - BEGIN); }
+    uint capacity() const { return uint(CAP - BEGIN); }
     bool is_empty() const { return BEGIN == END; }
 
     T& operator[](size_t i) { ASSERT(i < size_t(END - BEGIN)); return BEGIN[i]; }
@@ -82,14 +87,16 @@ public:
         ASSERT(BEGIN < END); 
 
         T *pBack = END;
-        END = --pBack;
+        vArray.pEnd = --pBack;
         return *pBack;
     }
 
+    // keeps the capacity, so set_end(0) is a cheap clear:
     T *set_end(size_t n)
     {
         ASSERT(size_t(CAP - BEGIN) >= n);
-        END = BEGIN + n;
+        vArray.pEnd = BEGIN + n;
+        return END;
     }
 
     void reserve(uint minCapacity)
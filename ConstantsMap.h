@@ -0,0 +1,158 @@
+#pragma once
+
+#include "common.h"
+#include "Array.h"
+
+#include <string.h> // memset
+
+// A scalar constant, by bit pattern, so the int 1 and the float with bits 0x00000001 don't collide:
+struct ScalarConstantKey {
+    uint32_t typeId; // SpvId of the type
+    uint32_t bits; // 0 or 1 for bools
+
+    uint64_t HashInput() const { return uint64_t(typeId) << 32 | bits; }
+    bool operator==(const ScalarConstantKey& other) const { return bits == other.bits && typeId == other.typeId; }
+};
+
+// An OpConstantComposite vector, by the ids of its (scalar constant) components, unused ones are 0:
+struct CompositeConstantKey {
+    uint32_t typeId;
+    uint32_t componentIds[4];
+
+    uint64_t HashInput() const
+    {
+        uint64_t h = typeId;
+        for (uint32_t id : componentIds) {
+            h = (h ^ id) * 0x100000001B3ull;
+        }
+        return h;
+    }
+    bool operator==(const CompositeConstantKey& other) const { return memcmp(this, &other, sizeof *this) == 0; }
+};
+
+// Just an id, for going from the id of a constant back to its key:
+struct SpvIdKey {
+    uint32_t id;
+
+    uint64_t HashInput() const { return id; }
+    bool operator==(const SpvIdKey& other) const { return id == other.id; }
+};
+
+/*
+    The constants of a module, by Key (type and value).
+
+    Open addressing with linear probing in a table of indices, the elements themselves are kept
+    in insertion order. So constants are emitted in the order they were first asked for, whatever
+    the hash does. Kept at most half full, so a probe is usually one or two slots.
+
+    Does not support removal, only Clear, pointers are not stable. Also what the value numbering
+    in main.cpp keeps its instructions in.
+**/
+template<class Key>
+class ConstantsMap {
+public:
+    struct Element {
+        Key key;
+        uint32_t id; // SpvId of the constant
+    };
+
+    struct FindElseInsertResult {
+        uint32_t *pId; // caller fills this in after knowing insert was succesful
+        bool inserted;
+    };
+
+private:
+    Array<Element> elements;
+    Array<uint32_t> slots; // index + 1 into elements, 0 if empty
+    uint slotBits = 0;
+
+    static uint
+    SlotOf(const Key& key, uint bits)
+    {
+        // Fibonacci hashing, the top bits of the product depend on all of the key:
+        return uint((key.HashInput() * 0x9E3779B97F4A7C15ull) >> (64 - bits));
+    }
+
+    void Grow()
+    {
+        slotBits = slotBits ? slotBits + 1 : 6;
+        uint const numSlots = 1u << slotBits;
+        slots.set_end(0);
+        slots.reserve(numSlots);
+        memset(slots.set_end(numSlots) - numSlots, 0, numSlots * sizeof(uint32_t));
+
+        uint32_t *const pSlots = slots.data();
+        uint const mask = numSlots - 1;
+        for (uint i = 0; i < elements.size(); ++i) {
+            uint slot = SlotOf(elements.data()[i].key, slotBits);
+            while (pSlots[slot]) {
+                slot = (slot + 1) & mask;
+            }
+            pSlots[slot] = i + 1;
+        }
+    }
+
+public:
+    uint size() const { return elements.size(); }
+    const Element *begin() const { return elements.begin(); }
+    const Element *end() const { return elements.end(); }
+
+    // Empties the slots that are in use, so it's the number of elements not the size of the table:
+    void Clear()
+    {
+        uint32_t *const pSlots = slots.data();
+        uint const mask = slots.size() - 1;
+        for (uint i = 0; i < elements.size(); ++i) {
+            uint slot = SlotOf(elements.data()[i].key, slotBits);
+            while (pSlots[slot] != i + 1) {
+                slot = (slot + 1) & mask;
+            }
+            pSlots[slot] = 0;
+        }
+        elements.set_end(0);
+    }
+
+    // The id of key, 0 if it isn't in the map:
+    uint32_t Find(const Key& key) const
+    {
+        if (!elements.size()) {
+            return 0;
+        }
+        const uint32_t *const pSlots = slots.data();
+        uint const mask = slots.size() - 1;
+        for (uint slot = SlotOf(key, slotBits);; slot = (slot + 1) & mask) {
+            uint32_t const index = pSlots[slot];
+            if (!index) {
+                return 0;
+            }
+            const Element& elem = elements.data()[index - 1];
+            if (elem.key == key) {
+                return elem.id;
+            }
+        }
+    }
+
+    FindElseInsertResult FindElseInsert(const Key& key)
+    {
+        if ((elements.size() + 1) * 2 > slots.size()) {
+            Grow();
+        }
+        uint32_t *const pSlots = slots.data();
+        uint const mask = slots.size() - 1;
+        for (uint slot = SlotOf(key, slotBits);; slot = (slot + 1) & mask) {
+            uint32_t const index = pSlots[slot];
+            if (!index) {
+                pSlots[slot] = elements.size() + 1;
+                elements.push(Element{ key, 0 });
+                return { &elements.end()[-1].id, true };
+            }
+            Element& elem = elements.data()[index - 1];
+            if (elem.key == key) {
+                return { &elem.id, false };
+            }
+        }
+    }
+};
+
+typedef ConstantsMap<ScalarConstantKey> ConstantsMapScaler32;
+typedef ConstantsMap<CompositeConstantKey> ConstantsMapComposite;
@@ -0,0 +1,497 @@
+/*
+    Decodes the token stream of a compiled DXBC container.
+
+    The token layout is the one in d3d11TokenizedProgramFormat.hpp (Windows SDK),
+    only the bits needed for what the text scanner understands are decoded here.
+    Anything else is reported as unknown/unsupported instead of being guessed at.
+*/
+#include "common.h"
+
+#include "DxbcBinaryScanner.h"
+
+#include <string.h>
+
+#define FOURCC(a, b, c, d) (uint32_t(a) | uint32_t(b) << 8 | uint32_t(c) << 16 | uint32_t(d) << 24)
+
+// D3D10_SB_OPCODE_TYPE, only the ones referenced here:
+enum : uint {
+    SbOp_Add = 0,
+    SbOp_And = 1,
+    SbOp_Break = 2,
+    SbOp_BreakC = 3,
+    SbOp_Continue = 7,
+    SbOp_ContinueC = 8,
+    SbOp_Else = 18,
+    SbOp_EndIf = 21,
+    SbOp_EndLoop = 22,
+    SbOp_IAdd = 30,
+    SbOp_If = 31,
+    SbOp_IEq = 32,
+    SbOp_IMad = 35,
+    SbOp_IShl = 41,
+    SbOp_Loop = 48,
+    SbOp_CustomData = 53,
+    SbOp_Mov = 54,
+    SbOp_MovC = 55,
+    SbOp_Not = 59,
+    SbOp_Or = 60,
+    SbOp_Ret = 62,
+    SbOp_ULt = 79,
+    SbOp_UGe = 80,
+    SbOp_Xor = 87,
+    SbOp_DclResource = 88, // first of the sm4 declarations
+    SbOp_DclInput = 95,
+    SbOp_DclTemps = 104,
+    SbOp_DclGlobalFlags = 106, // last of the sm4 declarations
+    SbOp_DclStream = 143, // first of the sm5 declarations
+    SbOp_DclThreadGroup = 155,
+    SbOp_DclUavTyped = 156,
+    SbOp_DclResourceStructured = 162, // last of the sm5 declarations
+    SbOp_LdUavTyped = 163,
+    SbOp_StoreUavTyped = 164,
+};
+
+// D3D10_SB_OPERAND_TYPE, only the ones referenced here:
+enum : uint {
+    SbOperand_Temp = 0,
+    SbOperand_Immediate32 = 4,
+    SbOperand_Uav = 30,
+    SbOperand_ThreadId = 32,
+    SbOperand_ThreadIdInGroupFlattened = 36,
+};
+
+enum : uint32_t {
+    SbOpcodeTokenSaturateBit = 1u << 13,
+    SbOpcodeTokenTestNonZeroBit = 1u << 18,
+    SbTokenExtendedBit = 1u << 31,
+    SbGlobalFlagRefactoringAllowed = 1u << 11,
+};
+
+struct SbOpcodeInfo {
+    uint16_t sbOpcode;
+    DxbcInstrTag instrTag;
+    DxbcInstrClass instrClass;
+};
+
+static const SbOpcodeInfo SbOpcodeTable[] = {
+#define DXBC_INSTR_SB_OPCODE_ENTRY(tag, mnemonic, cls, sbOp, spvOp, spvOpClass, lower) \
+    { SbOp_##sbOp, DxbcInstrTag::tag, DxbcInstrClass::cls },
+    DXBC_INSTRUCTIONS(DXBC_INSTR_SB_OPCODE_ENTRY)
+#undef DXBC_INSTR_SB_OPCODE_ENTRY
+};
+
+static const SbOpcodeInfo *
+LookupSbOpcodeInfo(uint sbOpcode)
+{
+    for (const SbOpcodeInfo& info : SbOpcodeTable) {
+        if (info.sbOpcode == sbOpcode) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+static bool
+IsDeclaration(uint sbOpcode)
+{
+    return (sbOpcode - SbOp_DclResource) <= (SbOp_DclGlobalFlags - SbOp_DclResource) ||
+           (sbOpcode - SbOp_DclStream) <= (SbOp_DclResourceStructured - SbOp_DclStream) ||
+           sbOpcode == SbOp_CustomData; // dcl_immediateConstantBuffer
+}
+
+static uint32_t
+ReadU32(const ubyte *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+DxbcBinaryScanResult
+DxbcBinary_InitFromContainer(DxbcBinaryScanner *scanner, const void *pBytes, size_t numBytes)
+{
+    scanner->pTokens = nullptr;
+    scanner->pEnd = nullptr;
+    scanner->pErrorToken = nullptr;
+    scanner->errorMessage = nullptr;
+
+    /*
+        Container header:
+            fourcc "DXBC", 16 byte checksum, uint32 1, uint32 total size, uint32 chunk count,
+            then a uint32 byte offset per chunk.
+        Chunk: fourcc, uint32 byte size, data.
+    */
+    const ubyte *const bytes = static_cast<const ubyte *>(pBytes);
+    if ((uintptr_t(bytes) & 3) || numBytes < 32 || ReadU32(bytes) != FOURCC('D', 'X', 'B', 'C')) {
+        return DxbcBinaryScanResult::BadContainer;
+    }
+    const uint32_t totalSize = ReadU32(bytes + 24);
+    const uint32_t numChunks = ReadU32(bytes + 28);
+    if (totalSize < 32 || totalSize > numBytes || numChunks > (totalSize - 32) / 4) {
+        return DxbcBinaryScanResult::BadContainer;
+    }
+
+    for (uint i = 0; i < numChunks; ++i) {
+        const uint32_t chunkOffset = ReadU32(bytes + 32 + i * 4);
+        if ((chunkOffset & 3) || chunkOffset > totalSize - 8) {
+            return DxbcBinaryScanResult::BadContainer;
+        }
+        const uint32_t fourcc = ReadU32(bytes + chunkOffset);
+        const uint32_t chunkSize = ReadU32(bytes + chunkOffset + 4);
+        if (fourcc != FOURCC('S', 'H', 'E', 'X') && fourcc != FOURCC('S', 'H', 'D', 'R')) {
+            continue;
+        }
+        if (chunkSize > totalSize - chunkOffset - 8 || chunkSize < 8) {
+            return DxbcBinaryScanResult::BadContainer;
+        }
+
+        // version token, then the length in tokens of the whole program (including these 2):
+        const uint32_t *const tokens = reinterpret_cast<const uint32_t *>(bytes + chunkOffset + 8);
+        const uint32_t numTokens = tokens[1];
+        if (numTokens < 2 || numTokens > chunkSize / 4) {
+            return DxbcBinaryScanResult::BadContainer;
+        }
+        const uint programType = tokens[0] >> 16;
+        if (programType != 5) { // D3D11_SB_COMPUTE_SHADER
+            return DxbcBinaryScanResult::NotComputeShader;
+        }
+        scanner->pTokens = tokens + 2;
+        scanner->pEnd = tokens + numTokens;
+        return DxbcBinaryScanResult::Okay;
+    }
+
+    return DxbcBinaryScanResult::BadContainer;
+}
+
+// Returns the number of tokens of the instruction starting at p, 0 if malformed.
+static uint
+InstructionLength(const uint32_t *p, const uint32_t *pEnd)
+{
+    uint len = (p[0] >> 24) & 0x7f;
+    if ((p[0] & 0x7ff) == SbOp_CustomData) {
+        len = (pEnd - p >= 2) ? p[1] : 0;
+    }
+    return len <= uint(pEnd - p) ? len : 0;
+}
+
+/*
+    Operand token:
+        [1:0]   number of components: 0, 1, 4, N
+        [3:2]   4-component selection mode: mask, swizzle, select1
+        [11:4]  mask / swizzle / select1 component
+        [19:12] operand type
+        [21:20] index dimension
+        [30:22] index representations, 3 bits each
+        [31]    extended, next token has modifiers (neg, abs)
+*/
+static DxbcBinaryScanResult
+DecodeOperand(const uint32_t **pp, const uint32_t *pInstrEnd, bool isDst, DxbcOperand *operand,
+              Array<DxbcImmediate> *immediates)
+{
+    const uint32_t *p = *pp;
+    if (p >= pInstrEnd) {
+        return DxbcBinaryScanResult::Other;
+    }
+    const uint32_t token = *p++;
+
+    *operand = {};
+
+    uint32_t extended = token & SbTokenExtendedBit;
+    while (extended) {
+        if (p >= pInstrEnd) {
+            return DxbcBinaryScanResult::Other;
+        }
+        const uint32_t extToken = *p++;
+        if ((extToken & 0x3f) == 1) { // D3D10_SB_EXTENDED_OPERAND_MODIFIER
+            const uint modifier = (extToken >> 6) & 0xff;
+            if (modifier & 1) operand->flags |= DxbcOperandFlag_SrcNeg;
+            if (modifier & 2) operand->flags |= DxbcOperandFlag_SrcAbs;
+        }
+        extended = extToken & SbTokenExtendedBit;
+    }
+
+    uint numComponents;
+    switch (token & 3) {
+    case 0: numComponents = 0; break;
+    case 1: numComponents = 1; break;
+    case 2: numComponents = 4; break;
+    default: return DxbcBinaryScanResult::UnsupportedOperand;
+    }
+
+    uint writeMask = 0;
+    uint swizzle = 0; // .xxxx
+    if (numComponents == 4) {
+        switch ((token >> 2) & 3) {
+        case 0: // mask
+            writeMask = (token >> 4) & 0xf;
+            swizzle = DxbcSourceSwizzle(0, 1, 2, 3).bits;
+            break;
+        case 1: // swizzle
+            swizzle = (token >> 4) & 0xff;
+            break;
+        case 2: // select1
+            swizzle = ((token >> 4) & 3) * 0x55u;
+            break;
+        default:
+            return DxbcBinaryScanResult::UnsupportedOperand;
+        }
+    }
+    else {
+        writeMask = 1;
+    }
+
+    const uint type = (token >> 12) & 0xff;
+    const uint indexDim = (token >> 20) & 3;
+    int slot = 0;
+    for (uint d = 0; d < indexDim; ++d) {
+        const uint representation = (token >> (22 + d * 3)) & 7;
+        if (representation != 0 || p >= pInstrEnd) { // only D3D10_SB_OPERAND_INDEX_IMMEDIATE32
+            return DxbcBinaryScanResult::UnsupportedOperand;
+        }
+        const uint32_t index = *p++;
+        if (d == 0) {
+            if (index >= 4096u) {
+                return DxbcBinaryScanResult::UnsupportedOperand;
+            }
+            slot = int(index);
+        }
+    }
+
+    switch (type) {
+    case SbOperand_Temp:
+        operand->file = DxbcFile::temp;
+        break;
+    case SbOperand_Uav:
+        operand->file = DxbcFile::uav;
+        break;
+    case SbOperand_ThreadId:
+        operand->file = DxbcFile::vThreadID;
+        break;
+    case SbOperand_ThreadIdInGroupFlattened:
+        operand->file = DxbcFile::vThreadIDInGroupFlattened;
+        break;
+    case SbOperand_Immediate32: {
+        if (isDst || !immediates || numComponents == 0 || pInstrEnd - p < ptrdiff_t(numComponents)) {
+            return DxbcBinaryScanResult::Other;
+        }
+        operand->file = DxbcFile::immediate;
+        slot = int(immediates->size());
+        DxbcImmediate *const imm = immediates->uninitialized_push();
+        for (uint c = 0; c < 4; ++c) {
+            imm->u[c] = p[numComponents == 4 ? c : 0];
+        }
+        p += numComponents;
+        swizzle = DxbcSourceSwizzle(0, 1, 2, 3).bits;
+    } break;
+    default:
+        return DxbcBinaryScanResult::UnsupportedOperand;
+    }
+
+    if (isDst) {
+        if (!writeMask || operand->flags) {
+            return DxbcBinaryScanResult::Other;
+        }
+        operand->dstWritemask = uint8_t(writeMask);
+    }
+    else {
+        operand->srcSwizzle.bits = uint8_t(swizzle);
+    }
+    operand->slotInFile = slot;
+
+    *pp = p;
+    return DxbcBinaryScanResult::Okay;
+}
+
+static DxbcBinaryScanResult
+DecodeDeclaration(const uint32_t *p, const uint32_t *pInstrEnd, DxbcHeaderInfo *headerInfo)
+{
+    const uint32_t opcodeToken = p[0];
+    switch (opcodeToken & 0x7ff) {
+    case SbOp_DclGlobalFlags: { // dcl_globalFlags refactoringAllowed
+        // DXBC_GLOBAL_FLAG_* are in the same order:
+        headerInfo->globalFlags |= uint8_t(opcodeToken / SbGlobalFlagRefactoringAllowed);
+    } break;
+    case SbOp_DclTemps: { // dcl_temps 1
+        if (pInstrEnd - p < 2 || p[1] - 1u >= 4096u) {
+            return DxbcBinaryScanResult::Other;
+        }
+        headerInfo->numTemps = uint16_t(p[1]);
+    } break;
+    case SbOp_DclThreadGroup: { // dcl_thread_group 64, 1, 1
+        if (pInstrEnd - p < 4) {
+            return DxbcBinaryScanResult::Other;
+        }
+        headerInfo->workgroupSize.x = int(p[1]);
+        headerInfo->workgroupSize.y = int(p[2]);
+        headerInfo->workgroupSize.z = int(p[3]);
+    } break;
+    case SbOp_DclInput: { // dcl_input vThreadID.x
+        const uint32_t *pOperand = p + 1;
+        DxbcOperand operand;
+        DxbcBinaryScanResult result = DecodeOperand(&pOperand, pInstrEnd, true, &operand, nullptr);
+        if (result != DxbcBinaryScanResult::Okay) {
+            return result;
+        }
+        if (operand.file == DxbcFile::vThreadIDInGroupFlattened) {
+            headerInfo->vThreadIDInGroupFlattened = true;
+        }
+        else if (operand.file == DxbcFile::vThreadID) {
+            headerInfo->vThreadID_usedMask |= operand.dstWritemask;
+        }
+        else {
+            return DxbcBinaryScanResult::UnsupportedOperand;
+        }
+    } break;
+    case SbOp_DclUavTyped: { // dcl_uav_typed_buffer (uint,uint,uint,uint) u0
+        // [15:11] dimension, [16] globally coherent, then the u# operand and a token with 4 bits of return type per component:
+        const uint32_t *pOperand = p + 1;
+        DxbcOperand operand;
+        DxbcBinaryScanResult result = DecodeOperand(&pOperand, pInstrEnd, true, &operand, nullptr);
+        if (result != DxbcBinaryScanResult::Okay) {
+            return result;
+        }
+        if (operand.file != DxbcFile::uav || uint(operand.slotInFile) >= DXBC_MAX_UAVS || pOperand >= pInstrEnd) {
+            return DxbcBinaryScanResult::UnsupportedOperand;
+        }
+        DxbcResourceDecl& decl = headerInfo->uavs[operand.slotInFile];
+        decl = {};
+        decl.dim = DxbcResourceDim((opcodeToken >> 11) & 0x1f);
+        decl.flags = (opcodeToken & (1u << 16)) ? uint8_t(DxbcResourceFlag_GloballyCoherent) : 0;
+        for (uint c = 0; c < 4; ++c) {
+            decl.returnTypes[c] = DxbcReturnType((*pOperand >> (c * 4)) & 0xf);
+        }
+        headerInfo->uavDeclMask |= uint64_t(1) << operand.slotInFile;
+    } break;
+    default: {
+        return DxbcBinaryScanResult::UnknownInstruction;
+    } break;
+    }
+    return DxbcBinaryScanResult::Okay;
+}
+
+DxbcBinaryScanResult
+DxbcBinary_ScanHeader(DxbcBinaryScanner *scanner, DxbcHeaderInfo *headerInfo)
+{
+    *headerInfo = { };
+
+    const uint32_t *p = scanner->pTokens;
+    while (p < scanner->pEnd && IsDeclaration(p[0] & 0x7ff)) {
+        const uint len = InstructionLength(p, scanner->pEnd);
+        if (!len) {
+            return DxbcBinaryScanResult::Other;
+        }
+        DxbcBinaryScanResult result = DecodeDeclaration(p, p + len, headerInfo);
+        if (result != DxbcBinaryScanResult::Okay) {
+            return result;
+        }
+        p += len;
+    }
+    scanner->pTokens = p;
+    return DxbcBinaryScanResult::Okay;
+}
+
+DxbcBinaryScanResult
+DxbcBinary_ScanInstrInFuncBody(DxbcBinaryScanner *scanner, DxbcInstruction *instr, Array<DxbcImmediate> *immediates)
+{
+    const uint32_t *p = scanner->pTokens;
+    if (p >= scanner->pEnd) {
+        return DxbcBinaryScanResult::Eof;
+    }
+
+    const uint len = InstructionLength(p, scanner->pEnd);
+    if (!len) {
+        return DxbcBinaryScanResult::Other;
+    }
+    const uint32_t *const pInstrEnd = p + len;
+
+    const uint32_t opcodeToken = *p++;
+    const SbOpcodeInfo *const info = LookupSbOpcodeInfo(opcodeToken & 0x7ff);
+    if (!info) {
+        scanner->pErrorToken = p - 1;
+        scanner->errorMessage = "unknown opcode";
+        return DxbcBinaryScanResult::UnknownInstruction;
+    }
+
+    // Skip extended opcode tokens, like the (buffer)(uint,uint,uint,uint) of ld_uav_typed:
+    for (uint32_t extended = opcodeToken & SbTokenExtendedBit; extended; extended = *p++ & SbTokenExtendedBit) {
+        if (p >= pInstrEnd) {
+            return DxbcBinaryScanResult::Other;
+        }
+    }
+
+    *instr = {};
+    instr->tag = info->instrTag;
+    instr->instrClass = info->instrClass;
+
+    uint numDests = instr->NumDstRegs();
+    uint numSrcs = instr->NumSrcRegs();
+    switch (info->instrTag) {
+    case DxbcInstrTag::if_:
+    case DxbcInstrTag::breakc:
+    case DxbcInstrTag::continuec:
+        numSrcs = 1;
+        if (opcodeToken & SbOpcodeTokenTestNonZeroBit) {
+            instr->flags |= DxbcInstrFlag_nz;
+        }
+        break;
+    case DxbcInstrTag::ld_uav_typed:
+        numDests = 1;
+        numSrcs = 2;
+        break;
+    default:
+        break;
+    }
+
+    instr->numOperands = uint8_t(numDests + numSrcs);
+    for (uint i = 0; i < numDests + numSrcs; ++i) {
+        DxbcBinaryScanResult result = DecodeOperand(&p, pInstrEnd, i < numDests, &instr->operands[i], immediates);
+        if (result != DxbcBinaryScanResult::Okay) {
+            return result;
+        }
+    }
+    if (numDests && (opcodeToken & SbOpcodeTokenSaturateBit)) {
+        instr->operands[0].flags |= DxbcOperandFlag_DstSat;
+    }
+
+    scanner->pTokens = pInstrEnd;
+    return DxbcBinaryScanResult::Okay;
+}
+
+bool
+DxbcBinary_ScanIsEof(DxbcBinaryScanner *scanner)
+{
+    return scanner->pTokens >= scanner->pEnd;
+}
+
+DxbcBinaryScanResult
+DxbcBinary_Decode(DxbcBinaryScanner *scanner, DxbcShader *shader)
+{
+    DxbcBinaryScanResult result = DxbcBinary_ScanHeader(scanner, &shader->header);
+    if (result != DxbcBinaryScanResult::Okay) {
+        return result;
+    }
+    // every instruction is at least 1 token (usually 5+), don't grow a few times for small shaders:
+    shader->instrs.reserve(uint(Max<ptrdiff_t>(scanner->pEnd - scanner->pTokens, 16) / 4));
+    DxbcControlFlowCheck controlFlow;
+    while (!DxbcBinary_ScanIsEof(scanner)) {
+        const uint32_t *const pInstrTokens = scanner->pTokens;
+        DxbcInstruction *instr = shader->instrs.uninitialized_push();
+        result = DxbcBinary_ScanInstrInFuncBody(scanner, instr, &shader->immediates);
+        if (result != DxbcBinaryScanResult::Okay) {
+            shader->instrs.pop();
+            scanner->pErrorToken = pInstrTokens;
+            return result;
+        }
+        if (const char *message = DxbcControlFlow_Check(&controlFlow, *instr)) {
+            scanner->pErrorToken = pInstrTokens;
+            scanner->errorMessage = message;
+            return DxbcBinaryScanResult::BadNesting;
+        }
+    }
+    if (const char *message = DxbcControlFlow_CheckEnd(&controlFlow)) {
+        scanner->pErrorToken = scanner->pEnd;
+        scanner->errorMessage = message;
+        return DxbcBinaryScanResult::BadNesting;
+    }
+    return DxbcBinaryScanResult::Okay;
+}
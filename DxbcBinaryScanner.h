@@ -0,0 +1,50 @@
+#pragma once
+
+/*
+    Front-end for compiled DXBC containers (the SHEX/SHDR token stream), producing the same
+    DxbcHeaderInfo and DxbcInstruction as the text scanner, so Codegen does not care which
+    one it got.
+*/
+
+#include "DxbcTextScanner.h"
+
+#include <stddef.h>
+
+enum class DxbcBinaryScanResult {
+    Okay,
+    Eof,
+    BadContainer, // not DXBC, truncated, or no SHEX/SHDR chunk
+    NotComputeShader,
+    UnknownInstruction,
+    UnsupportedOperand,
+    BadNesting, // see DxbcControlFlowCheck
+    Other,
+};
+
+struct DxbcBinaryScanner {
+    const uint32_t *pTokens; // next opcode token
+    const uint32_t *pEnd;
+
+    // Set when scanning an instruction fails, for the caller to report:
+    const uint32_t *pErrorToken; // opcode token of that instruction, pEnd if the body ended too early
+    const char *errorMessage; // nullptr if the result says it all
+};
+
+// Finds the SHEX/SHDR chunk, pBytes must be 4-byte aligned:
+DxbcBinaryScanResult
+DxbcBinary_InitFromContainer(DxbcBinaryScanner *scanner, const void *pBytes, size_t numBytes);
+
+// Collects info about every declaration before the first instruction:
+DxbcBinaryScanResult
+DxbcBinary_ScanHeader(DxbcBinaryScanner *scanner, DxbcHeaderInfo *headerInfo);
+
+// Values of immediate operands are appended to immediates:
+DxbcBinaryScanResult
+DxbcBinary_ScanInstrInFuncBody(DxbcBinaryScanner *scanner, DxbcInstruction *instr, Array<DxbcImmediate> *immediates);
+
+bool
+DxbcBinary_ScanIsEof(DxbcBinaryScanner *scanner);
+
+// Scans the declarations and the whole function body in a single pass:
+DxbcBinaryScanResult
+DxbcBinary_Decode(DxbcBinaryScanner *scanner, DxbcShader *shader);
@@ -3,19 +3,23 @@
 
     Could cleanup a bit.
 
-    If a bad input string is detected, will crash with a message.
-    XXX: Some of those are asserts?, but should be in non-debug builds too.
+    If a bad input string is detected, returns an error with a message and where it was,
+    see DxbcText_GetErrorLocation.
 
-    Should add line number info to messages, and should handle at least // comments.
+    Handles // comments, so the whole fxc /Fc output can be scanned as is.
 */
 #include "common.h"
 
 #include "DxbcTextScanner.h"
 
+#include <float.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <thread>
+#include <vector>
+
 struct ByteView {
     const char *pbegin;
     const char *pend;
@@ -37,165 +41,1295 @@ static bool EqualStrZ(ByteView view, const char *sz)
     return strncmp(view.pbegin, sz, len) == 0 && sz[len] == 0;
 }
 
+
+struct DxbcInstrStringInfo {
+    const char *name;
+    uint8_t nameLength;
+    DxbcInstrTag instrTag;
+    DxbcInstrClass instrClass;
+};
+
+constexpr uint8_t ConstStrLen(const char *s)
+{
+    return *s ? uint8_t(1 + ConstStrLen(s + 1)) : 0;
+}
+
+#define STRING_TABLE_ENTRY(str, tag, cls) { str, ConstStrLen(str), DxbcInstrTag::tag, DxbcInstrClass::cls }
+
+static constexpr DxbcInstrStringInfo StringTable[] = {
+#define DXBC_INSTR_STRING_TABLE_ENTRY(tag, mnemonic, cls, sbOp, spvOp, spvOpClass, lower) STRING_TABLE_ENTRY(mnemonic, tag, cls),
+    DXBC_INSTRUCTIONS(DXBC_INSTR_STRING_TABLE_ENTRY)
+#undef DXBC_INSTR_STRING_TABLE_ENTRY
+    // other spellings:
+    STRING_TABLE_ENTRY("ld_uav_typed_indexable", ld_uav_typed,          misc_in_function_body),
+    STRING_TABLE_ENTRY("breakc_z",               breakc,                misc_in_function_body),
+    STRING_TABLE_ENTRY("continuec_z",            continuec,             misc_in_function_body),
+    // declarations are in DeclSyntaxTable
+};
+
+#undef STRING_TABLE_ENTRY
+
+/*
+    Perfect hash of the mnemonics in StringTable, so a lookup is one probe and one compare.
+
+    The key is the length plus the first two and last two characters. Length plus first and
+    last alone is not enough, e.g: { and, add } and { iadd, imad }. Every name is at least
+    2 characters, so the 4 loads never go outside the name.
+
+    The multiplier is searched for at compile time (first one with no collisions wins),
+    so adding a row to StringTable is all that is needed. If that ever fails to find one,
+    bump PerfectHashBits.
+*/
+enum : uint { PerfectHashBits = 7, PerfectHashSize = 1u << PerfectHashBits };
+static constexpr uint8_t PerfectHashEmptySlot = 0xff;
+
+static_assert(lengthof(StringTable) < PerfectHashEmptySlot, "slot index is a uint8_t");
+
+constexpr uint32_t
+PerfectHashKey(const char *s, uint len)
+{
+    return (uint32_t(ubyte(s[0])) | uint32_t(ubyte(s[1])) << 8 |
+            uint32_t(ubyte(s[len - 2])) << 16 | uint32_t(ubyte(s[len - 1])) << 24) ^ (len * 0x9E3779B9u);
+}
+
+constexpr uint
+PerfectHash(uint32_t key, uint32_t mul)
+{
+    return uint32_t(key * mul) >> (32 - PerfectHashBits);
+}
+
+constexpr uint
+HashOfEntry(uint i, uint32_t mul)
+{
+    return PerfectHash(PerfectHashKey(StringTable[i].name, StringTable[i].nameLength), mul);
+}
+
+constexpr bool
+CollidesWithLaterEntry(uint i, uint j, uint32_t mul)
+{
+    return j < lengthof(StringTable) &&
+        (HashOfEntry(i, mul) == HashOfEntry(j, mul) || CollidesWithLaterEntry(i, j + 1, mul));
+}
+
+constexpr bool
+HasCollision(uint32_t mul, uint i = 0)
+{
+    return i < lengthof(StringTable) &&
+        (CollidesWithLaterEntry(i, i + 1, mul) || HasCollision(mul, i + 1));
+}
+
+constexpr uint32_t
+FindPerfectHashMultiplier(uint attempt = 0)
+{
+    // odd multipliers spread out over the 32-bit range:
+    return attempt == 256 ? 0 :
+        !HasCollision(0x2545F491u + attempt * 0x9E3779B8u) ? (0x2545F491u + attempt * 0x9E3779B8u) :
+        FindPerfectHashMultiplier(attempt + 1);
+}
+
+static constexpr uint32_t PerfectHashMultiplier = FindPerfectHashMultiplier();
+static_assert(PerfectHashMultiplier != 0, "no perfect hash found for StringTable, bump PerfectHashBits");
+
+constexpr uint8_t
+StringTableIndexOfSlot(uint slot, uint i = 0)
+{
+    return i == lengthof(StringTable) ? PerfectHashEmptySlot :
+        HashOfEntry(i, PerfectHashMultiplier) == slot ? uint8_t(i) :
+        StringTableIndexOfSlot(slot, i + 1);
+}
+
+template<uint... Slots>
+struct PerfectHashSlotTable {
+    static constexpr uint8_t slots[sizeof...(Slots)] = { StringTableIndexOfSlot(Slots)... };
+};
+template<uint... Slots>
+constexpr uint8_t PerfectHashSlotTable<Slots...>::slots[sizeof...(Slots)];
+
+template<uint... Slots>
+static constexpr const uint8_t *SlotsOf(IndexList<Slots...>) { return PerfectHashSlotTable<Slots...>::slots; }
+
+static const uint8_t *const StringTableSlots = SlotsOf(MakeIndexList<PerfectHashSize>::type());
+
+static const DxbcInstrStringInfo *
+LookupInstrInfo(ByteView view)
+{
+    const uint len = view.Length();
+    if (len - 2u > 64u) {
+        return nullptr; // less than 2 chars, or way too long
+    }
+    const uint slot = PerfectHash(PerfectHashKey(view.pbegin, len), PerfectHashMultiplier);
+    const uint index = StringTableSlots[slot];
+    if (index == PerfectHashEmptySlot) {
+        return nullptr;
+    }
+    const DxbcInstrStringInfo& info = StringTable[index];
+    if (info.nameLength == len && memcmp(view.pbegin, info.name, len) == 0) {
+        return &info;
+    }
+    return nullptr;
+}
+
+
+/*
+    Character class scanning, 16 (SSE2) or 32 (AVX2) bytes at a time.
+
+    Vector loads are only done while a whole vector fits before the end of the input,
+    the tail is done a byte at a time, so nothing past the end is ever read.
+
+    Define DXBC_SCANNER_NO_SIMD to get the portable byte-at-a-time loops.
+*/
+enum class CharClass {
+    whitespace, // ' ', '\t', '\n', '\r'
+    identifier, // [A-Za-z0-9_]
+    digit,
+};
+
+template<CharClass cls>
+static bool IsInCharClass(uint c)
+{
+    switch (cls) {
+    case CharClass::whitespace: return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    case CharClass::identifier: return ((c | 32u) - 'a') < 26u || c == '_' || (c - '0') < 10u;
+    case CharClass::digit: return (c - '0') < 10u;
+    }
+    return false;
+}
+
+#if !defined(DXBC_SCANNER_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_SIMD_WIDTH 32
+#define SCAN_SIMD_ALL_BYTES 0xffffffffu
+typedef __m256i SimdBytes;
+static SimdBytes SimdLoad(const char *p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)); }
+static SimdBytes SimdSplat(char c) { return _mm256_set1_epi8(c); }
+static SimdBytes SimdEq(SimdBytes a, SimdBytes b) { return _mm256_cmpeq_epi8(a, b); }
+static SimdBytes SimdGt(SimdBytes a, SimdBytes b) { return _mm256_cmpgt_epi8(a, b); } // signed
+static SimdBytes SimdOr(SimdBytes a, SimdBytes b) { return _mm256_or_si256(a, b); }
+static SimdBytes SimdAnd(SimdBytes a, SimdBytes b) { return _mm256_and_si256(a, b); }
+static uint SimdMoveMask(SimdBytes v) { return uint(_mm256_movemask_epi8(v)); }
+#elif !defined(DXBC_SCANNER_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define SCAN_SIMD_WIDTH 16
+#define SCAN_SIMD_ALL_BYTES 0xffffu
+typedef __m128i SimdBytes;
+static SimdBytes SimdLoad(const char *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+static SimdBytes SimdSplat(char c) { return _mm_set1_epi8(c); }
+static SimdBytes SimdEq(SimdBytes a, SimdBytes b) { return _mm_cmpeq_epi8(a, b); }
+static SimdBytes SimdGt(SimdBytes a, SimdBytes b) { return _mm_cmpgt_epi8(a, b); } // signed
+static SimdBytes SimdOr(SimdBytes a, SimdBytes b) { return _mm_or_si128(a, b); }
+static SimdBytes SimdAnd(SimdBytes a, SimdBytes b) { return _mm_and_si128(a, b); }
+static uint SimdMoveMask(SimdBytes v) { return uint(_mm_movemask_epi8(v)); }
+#else
+#define SCAN_SIMD_WIDTH 0
+#endif
+
+#if SCAN_SIMD_WIDTH
+// Bit i set if byte i is in the class. Bytes >= 0x80 are negative for the signed compares,
+// so they never land in a range.
+template<CharClass cls>
+static uint CharClassMask(SimdBytes v)
+{
+    switch (cls) {
+    case CharClass::whitespace:
+        return SimdMoveMask(SimdOr(SimdOr(SimdEq(v, SimdSplat(' ')), SimdEq(v, SimdSplat('\n'))),
+                                   SimdOr(SimdEq(v, SimdSplat('\r')), SimdEq(v, SimdSplat('\t')))));
+    case CharClass::identifier: {
+        SimdBytes const lower = SimdOr(v, SimdSplat(32));
+        SimdBytes const alpha = SimdAnd(SimdGt(lower, SimdSplat('a' - 1)), SimdGt(SimdSplat('z' + 1), lower));
+        SimdBytes const digit = SimdAnd(SimdGt(v, SimdSplat('0' - 1)), SimdGt(SimdSplat('9' + 1), v));
+        return SimdMoveMask(SimdOr(SimdOr(alpha, digit), SimdEq(v, SimdSplat('_'))));
+    }
+    case CharClass::digit:
+        return SimdMoveMask(SimdAnd(SimdGt(v, SimdSplat('0' - 1)), SimdGt(SimdSplat('9' + 1), v)));
+    }
+    return 0;
+}
+#endif
+
+// Returns the first char at or after p that is not in the class, or pEnd.
+template<CharClass cls>
+static const char *
+SkipCharClass(const char *p, const char *pEnd)
+{
+    // Most runs are 0 or 1 chars long (a single space, a 1 digit register),
+    // don't pay for a vector load for those:
+    if (p == pEnd || !IsInCharClass<cls>(ubyte(p[0]))) {
+        return p;
+    }
+    if (++p == pEnd || !IsInCharClass<cls>(ubyte(p[0]))) {
+        return p;
+    }
+#if SCAN_SIMD_WIDTH
+    while (pEnd - p >= SCAN_SIMD_WIDTH) {
+        // 1 bits for the bytes not in the class:
+        uint const stopMask = ~CharClassMask<cls>(SimdLoad(p)) & SCAN_SIMD_ALL_BYTES;
+        if (stopMask) {
+            return p + bsf(stopMask);
+        }
+        p += SCAN_SIMD_WIDTH;
+    }
+#endif
+    while (p != pEnd && IsInCharClass<cls>(ubyte(*p))) {
+        ++p;
+    }
+    return p;
+}
+
+static const char *
+SkipRestOfLine(const char *p, const char *pEnd)
+{
+    const char *const pNewline = static_cast<const char *>(memchr(p, '\n', size_t(pEnd - p)));
+    return pNewline ? pNewline + 1 : pEnd;
+}
+
+static uint
+PopCount(uint v)
+{
+    v = v - ((v >> 1) & 0x55555555u);
+    v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+    return (((v + (v >> 4)) & 0x0f0f0f0fu) * 0x01010101u) >> 24;
+}
+
+/*
+    Lines are never counted while scanning, only for diagnostics, these do it a vector at a time.
+*/
+static uint
+CountNewlines(const char *p, const char *pEnd)
+{
+    uint n = 0;
+#if SCAN_SIMD_WIDTH
+    SimdBytes const newline = SimdSplat('\n');
+    for (; pEnd - p >= SCAN_SIMD_WIDTH; p += SCAN_SIMD_WIDTH) {
+        n += PopCount(SimdMoveMask(SimdEq(SimdLoad(p), newline)));
+    }
+#endif
+    for (; p != pEnd; ++p) {
+        n += *p == '\n';
+    }
+    return n;
+}
+
+// Counts the newlines before p
+static DxbcTextLocation
+LocationOf(const char *pText, const char *p)
+{
+    const char *pLineBegin = p;
+    while (pLineBegin != pText && pLineBegin[-1] != '\n') {
+        --pLineBegin;
+    }
+    return { CountNewlines(pText, pLineBegin) + 1, uint(p - pLineBegin) + 1 };
+}
+
+/*
+    Comments count as whitespace, so raw fxc /Fc output can be fed in: the banner, resource
+    bindings and signatures are all "//" lines before cs_5_0, and there's an instruction count
+    comment after the last ret. Lines starting with '#' are skipped too, those are the #line
+    directives of listings compiled with debug info, no DXBC token starts with '#'.
+    Comments are long and few, so memchr for their end.
+*/
+static const char *
+SkipWs(const char *p, const char *pEnd)
+{
+    for (;;) {
+        p = SkipCharClass<CharClass::whitespace>(p, pEnd);
+        if (p == pEnd) {
+            return p;
+        }
+        if (p[0] == '/' && pEnd - p >= 2 && p[1] == '/') {
+            p = SkipRestOfLine(p + 2, pEnd);
+        }
+        else if (p[0] == '#') {
+            p = SkipRestOfLine(p + 1, pEnd);
+        }
+        else {
+            return p;
+        }
+    }
+}
+
+static void
+SkipWs(DxbcTextScanner *scanner)
+{
+    scanner->pSrc = SkipWs(scanner->pSrc, scanner->pEnd);
+}
+
+// 0 at the end of the input:
+static uint
+PeekChar(const DxbcTextScanner *scanner)
+{
+    return scanner->pSrc != scanner->pEnd ? ubyte(scanner->pSrc[0]) : 0;
+}
+
+static bool IsAlphaOrUnderscore(uint c)
+{
+    return ((c | 32u) - 'a') < 26u || c == '_';
+}
+
+static bool IsDecimalDigit(uint c)
+{
+    return c - '0' < 10u;
+}
+
+/*
+    Writemasks and swizzles are 1 to 4 of xyzw, decoded a whole string at a time instead of per char:
+    the (up to) 4 chars are read as one little-endian word, checked with a couple of SWAR adds,
+    and since the low 2 bits of 'x', 'y', 'z', 'w' are 0, 1, 2, 3 a multiply gathers them into the
+    lined up swizzle bits (char i in bits 2i, as in DxbcSourceSwizzle).
+    Those bits plus the length index a table of all 4 + 16 + 64 + 256 = 340 strings for the writemask.
+*/
+constexpr uint
+CompStringTableBase(uint len)
+{
+    return ((1u << 2 * len) - 4u) / 3u; // 0, 4, 20, 84
+}
+
+constexpr uint
+CompStringLengthOfIndex(uint i)
+{
+    return i < CompStringTableBase(2) ? 1 : i < CompStringTableBase(3) ? 2 : i < CompStringTableBase(4) ? 3 : 4;
+}
+
+constexpr uint8_t
+WriteMaskOfSwizzle(uint swizzle, uint len, uint mask = 0)
+{
+    return len == 0 ? uint8_t(mask) :
+        (mask & 1u << (swizzle & 3u)) ? 0 :
+        WriteMaskOfSwizzle(swizzle >> 2, len - 1, mask | 1u << (swizzle & 3u));
+}
+
+template<uint... Is>
+struct CompStringWriteMaskTable {
+    static constexpr uint8_t writeMasks[sizeof...(Is)] = {
+        WriteMaskOfSwizzle(Is - CompStringTableBase(CompStringLengthOfIndex(Is)), CompStringLengthOfIndex(Is))...
+    };
+};
+template<uint... Is>
+constexpr uint8_t CompStringWriteMaskTable<Is...>::writeMasks[sizeof...(Is)];
+
+template<uint... Is>
+static constexpr const uint8_t *WriteMasksOf(IndexList<Is...>) { return CompStringWriteMaskTable<Is...>::writeMasks; }
+
+static const uint8_t *const CompStringWriteMasks = WriteMasksOf(MakeIndexList<CompStringTableBase(5)>::type());
+
+// str is 1 to 4 chars and nothing past pTextEnd is read, returns false if they aren't all xyzw (either case):
+static bool
+DecodeCompString(ByteView str, const char *pTextEnd, uint *pSwizzle)
+{
+    uint const len = str.Length();
+    ASSERT(len - 1u < 4u);
+    uint32_t word;
+    if (pTextEnd - str.pbegin >= 4) {
+        memcpy(&word, str.pbegin, 4); // the bytes past str are masked off below
+    }
+    else {
+        word = 0;
+        memcpy(&word, str.pbegin, len);
+    }
+    uint32_t const highBits = 0x80808080u >> (32 - len * 8); // of the bytes in str
+    word |= 0x20202020u;
+    // every byte of str in 'w'..'z' (0x77..0x7a), a byte whose add carries into the next one fails itself:
+    if ((~(word + 0x09090909u) | (word + 0x05050505u)) & highBits) {
+        return false;
+    }
+    // byte i's low 2 bits to bits 24 + 2i, the cross products land either below bit 24 or past bit 31:
+    *pSwizzle = ((word & (highBits >> 7) * 3u) * 0x01041040u) >> 24;
+    return true;
+}
+
+// 0 if a component repeats, can't be a writemask then:
+static uint
+WriteMaskOfCompString(uint swizzle, uint len)
+{
+    return CompStringWriteMasks[CompStringTableBase(len) + swizzle];
+}
+
+static DxbcTextScanResult
+ScanCName(DxbcTextScanner *scanner, ByteView *out)
+{
+    const char *p = SkipWs(scanner->pSrc, scanner->pEnd);
+    out->pbegin = p;
+    out->pend = p;
+    scanner->pSrc = p;
+    if (p == scanner->pEnd) {
+        return DxbcTextScanResult::Eof;
+    }
+    if (!IsAlphaOrUnderscore(ubyte(*p))) {
+        return DxbcTextScanResult::ExpectedAlpha;
+    }
+    p = SkipCharClass<CharClass::identifier>(p + 1, scanner->pEnd);
+    out->pend = p;
+    scanner->pSrc = p;
+    return DxbcTextScanResult::Okay;
+}
+
+static uint
+ScanChar(DxbcTextScanner *scanner)
+{
+    const char *p = SkipWs(scanner->pSrc, scanner->pEnd);
+    if (p == scanner->pEnd) {
+        scanner->pSrc = p;
+        return 0;
+    }
+    scanner->pSrc = p + 1;
+    return ubyte(*p);
+}
+
+/*
+    Bad input never exits or asserts: the scanner remembers where (pErrorAt) and why (errorMessage)
+    and the error goes back up through DxbcTextScanResult. The line and column are only worked out
+    when someone asks, see DxbcText_GetErrorLocation.
+*/
+static DxbcTextScanResult
+ScanError(DxbcTextScanner *scanner, const char *pAt, DxbcTextScanResult result, const char *message)
+{
+    scanner->pErrorAt = pAt;
+    scanner->errorMessage = message;
+    return result;
+}
+
+#define SCAN_VERIFY_AT(e, pAt, result, message) \
+    do { if (!(e)) { return ScanError(scanner, pAt, DxbcTextScanResult::result, message); } } while (0)
+
+#define SCAN_VERIFY(e, result, message) SCAN_VERIFY_AT(e, scanner->pSrc, result, message)
+
+// For the scan functions that fail without a message, scanner->pSrc is left where it went wrong:
+#define SCAN_TRY(call, message) \
+    do { \
+        DxbcTextScanResult const scanResult_ = (call); \
+        if (scanResult_ != DxbcTextScanResult::Okay) { \
+            return ScanError(scanner, scanner->pSrc, scanResult_, message); \
+        } \
+    } while (0)
+
+/*
+    Numbers, instead of strtol/strtof/sscanf: those depend on the process locale (a ',' decimal
+    point breaks every float immediate), want a 0-terminated string, and report errors through
+    errno. These work on the (begin, end) range and only advance *ppSrc on success.
+*/
+static uint
+HexDigitValue(uint c)
+{
+    if (c - '0' < 10u) {
+        return c - '0';
+    }
+    c |= 0x20; // lower case
+    return c - 'a' < 6u ? c - 'a' + 10 : 16;
+}
+
+// [-+]?(0x[0-9a-fA-F]+|[0-9]+), anything from INT32_MIN to UINT32_MAX, as 32 bits:
+static DxbcTextScanResult
+ParseInt32Bits(const char **ppSrc, const char *pEnd, uint32_t *out)
+{
+    const char *p = *ppSrc;
+    bool neg = false;
+    if (p != pEnd && (*p == '-' || *p == '+')) {
+        neg = *p++ == '-';
+    }
+    uint64_t mag = 0;
+    const char *pDigits;
+    if (pEnd - p > 2 && p[0] == '0' && (p[1] | 0x20) == 'x' && HexDigitValue(ubyte(p[2])) < 16u) {
+        for (pDigits = p += 2; p != pEnd; ++p) {
+            uint const d = HexDigitValue(ubyte(*p));
+            if (d >= 16u) {
+                break;
+            }
+            mag = mag << 4 | d;
+            if (mag > UINT32_MAX) {
+                return DxbcTextScanResult::NumberOutOfRange;
+            }
+        }
+    }
+    else {
+        for (pDigits = p; p != pEnd; ++p) {
+            uint const d = ubyte(*p) - '0';
+            if (d >= 10u) {
+                break;
+            }
+            mag = mag * 10 + d;
+            if (mag > UINT32_MAX) {
+                return DxbcTextScanResult::NumberOutOfRange;
+            }
+        }
+    }
+    if (p == pDigits) {
+        return DxbcTextScanResult::ExpectedNumber;
+    }
+    if (neg && mag > 0x80000000u) {
+        return DxbcTextScanResult::NumberOutOfRange;
+    }
+    *out = neg ? uint32_t(0 - mag) : uint32_t(mag);
+    *ppSrc = p;
+    return DxbcTextScanResult::Okay;
+}
+
+/*
+    Exact decimal, for the rare floats the fast path in ParseFloat can't do (more than 19 digits,
+    large exponents, denormals, and double results exactly between two floats).
+    This is the "decimal shift" algorithm, like Go's strconv: shift the decimal by powers of 2
+    until it is in [0.5, 1), then take the mantissa bits off the top, rounding once.
+*/
+struct SlowDecimal {
+    enum { MaxDigits = 800, MaxShift = 60 };
+    uint8_t d[MaxDigits]; // 0-9, not chars
+    int nd; // number of digits used
+    int dp; // decimal point, value is 0.d[0]d[1]... * 10^dp
+    bool neg;
+    bool trunc; // discarded nonzero digits beyond d[0:nd]
+};
+
+static void
+TrimZeros(SlowDecimal *a)
+{
+    while (a->nd > 0 && a->d[a->nd - 1] == 0) {
+        a->nd--;
+    }
+    if (a->nd == 0) {
+        a->dp = 0;
+    }
+}
+
+// Already validated by ParseFloat, [-+]?[0-9]*(\.[0-9]*)?([eE][-+]?[0-9]+)?
+static void
+SlowDecimalFromText(SlowDecimal *a, const char *p, const char *pEnd)
+{
+    a->nd = 0;
+    a->dp = 0;
+    a->trunc = false;
+    a->neg = *p == '-';
+    p += (*p == '-' || *p == '+');
+    bool sawDot = false;
+    for (; p != pEnd; ++p) {
+        if (*p == '.') {
+            sawDot = true;
+            a->dp = a->nd;
+            continue;
+        }
+        uint const d = ubyte(*p) - '0';
+        if (d >= 10u) {
+            break;
+        }
+        if (d == 0 && a->nd == 0) { // leading zeros
+            a->dp--;
+            continue;
+        }
+        if (a->nd < SlowDecimal::MaxDigits) {
+            a->d[a->nd++] = uint8_t(d);
+        }
+        else if (d) {
+            a->trunc = true;
+        }
+    }
+    if (!sawDot) {
+        a->dp = a->nd;
+    }
+    if (p != pEnd) { // exponent
+        ++p;
+        bool const negExp = *p == '-';
+        p += (*p == '-' || *p == '+');
+        int e = 0;
+        for (; p != pEnd && IsDecimalDigit(ubyte(*p)); ++p) {
+            if (e < 10000) {
+                e = e * 10 + (*p - '0');
+            }
+        }
+        a->dp += negExp ? -e : e;
+    }
+    TrimZeros(a);
+}
+
+static void
+SlowDecimalLeftShift(SlowDecimal *a, uint k)
+{
+    // Produce the digits of a * 2^k from the last one, into the tail of tmp:
+    uint8_t tmp[SlowDecimal::MaxDigits + 20];
+    int w = lengthof(tmp);
+    uint64_t n = 0;
+    for (int r = a->nd - 1; r >= 0; --r) {
+        n += uint64_t(a->d[r]) << k;
+        uint64_t const quo = n / 10;
+        tmp[--w] = uint8_t(n - quo * 10);
+        n = quo;
+    }
+    while (n) {
+        uint64_t const quo = n / 10;
+        tmp[--w] = uint8_t(n - quo * 10);
+        n = quo;
+    }
+    int const numDigits = int(lengthof(tmp)) - w;
+    a->dp += numDigits - a->nd;
+    a->nd = numDigits < SlowDecimal::MaxDigits ? numDigits : int(SlowDecimal::MaxDigits);
+    for (int i = a->nd; i < numDigits; ++i) {
+        a->trunc |= tmp[w + i] != 0;
+    }
+    memcpy(a->d, tmp + w, a->nd);
+    TrimZeros(a);
+}
+
+static void
+SlowDecimalRightShift(SlowDecimal *a, uint k)
+{
+    int r = 0; // read
+    int w = 0; // write
+    uint64_t n = 0;
+    // Pick up enough leading digits to cover the shift:
+    for (; (n >> k) == 0; r++) {
+        if (r >= a->nd) {
+            if (n == 0) {
+                a->nd = 0;
+                return;
+            }
+            while ((n >> k) == 0) {
+                n *= 10;
+                r++;
+            }
+            break;
+        }
+        n = n * 10 + a->d[r];
+    }
+    a->dp -= r - 1;
+    uint64_t const mask = (uint64_t(1) << k) - 1;
+    for (; r < a->nd; r++) {
+        a->d[w++] = uint8_t(n >> k);
+        n = (n & mask) * 10 + a->d[r];
+    }
+    while (n > 0) {
+        uint const dig = uint(n >> k);
+        n &= mask;
+        if (w < SlowDecimal::MaxDigits) {
+            a->d[w++] = uint8_t(dig);
+        }
+        else if (dig) {
+            a->trunc = true;
+        }
+        n *= 10;
+    }
+    a->nd = w;
+    TrimZeros(a);
+}
+
+// Multiplies by 2^k, k may be negative:
 static void
-Println(FILE *fp, const char *s, const ByteView view)
+SlowDecimalShift(SlowDecimal *a, int k)
+{
+    if (a->nd == 0) {
+        return;
+    }
+    for (; k > SlowDecimal::MaxShift; k -= SlowDecimal::MaxShift) {
+        SlowDecimalLeftShift(a, SlowDecimal::MaxShift);
+    }
+    for (; k < -SlowDecimal::MaxShift; k += SlowDecimal::MaxShift) {
+        SlowDecimalRightShift(a, SlowDecimal::MaxShift);
+    }
+    if (k > 0) {
+        SlowDecimalLeftShift(a, uint(k));
+    }
+    else if (k < 0) {
+        SlowDecimalRightShift(a, uint(-k));
+    }
+}
+
+// Integer part, rounded to nearest even, dp must be <= 19:
+static uint64_t
+SlowDecimalRoundedInteger(const SlowDecimal *a)
+{
+    uint64_t n = 0;
+    int i = 0;
+    for (; i < a->dp && i < a->nd; i++) {
+        n = n * 10 + a->d[i];
+    }
+    for (; i < a->dp; i++) {
+        n *= 10;
+    }
+    const int nd = a->dp;
+    if (nd >= 0 && nd < a->nd) {
+        bool roundUp = a->d[nd] >= 5;
+        if (a->d[nd] == 5 && nd + 1 == a->nd && !a->trunc) { // exactly halfway, to even
+            roundUp = n & 1;
+        }
+        n += roundUp;
+    }
+    return n;
+}
+
+static DxbcTextScanResult
+SlowDecimalToFloatBits(SlowDecimal *a, uint32_t *out)
 {
-    fputs(s, fp);
-    fwrite(view.pbegin, 1, view.Length(), stdout);
-    fputc('\n', fp);
+    enum { MantBits = 23, ExpBits = 8, Bias = -127 };
+    static const uint8_t powtab[] = { 1, 3, 6, 9, 13, 16, 19, 23, 26 }; // 2^powtab[i] < 10^i
+    uint32_t const sign = uint32_t(a->neg) << 31;
+
+    if (a->nd == 0 || a->dp < -46) { // zero, or rounds to it
+        *out = sign;
+        return DxbcTextScanResult::Okay;
+    }
+    if (a->dp > 39) {
+        return DxbcTextScanResult::NumberOutOfRange;
+    }
+    // Scale to [0.5, 1):
+    int exp = 0;
+    while (a->dp > 0) {
+        int const n = a->dp >= int(lengthof(powtab)) ? 27 : powtab[a->dp];
+        SlowDecimalShift(a, -n);
+        exp += n;
+    }
+    while (a->dp < 0 || (a->dp == 0 && a->d[0] < 5)) {
+        int const n = -a->dp >= int(lengthof(powtab)) ? 27 : powtab[-a->dp];
+        SlowDecimalShift(a, n);
+        exp -= n;
+    }
+    exp--; // [0.5, 1) -> [1, 2)
+    if (exp < Bias + 1) { // denormal
+        int const n = Bias + 1 - exp;
+        SlowDecimalShift(a, -n);
+        exp += n;
+    }
+    if (exp - Bias >= (1 << ExpBits) - 1) {
+        return DxbcTextScanResult::NumberOutOfRange;
+    }
+    SlowDecimalShift(a, 1 + MantBits);
+    uint64_t mant = SlowDecimalRoundedInteger(a);
+    if (mant == uint64_t(2) << MantBits) { // rounding carried into a new bit
+        mant >>= 1;
+        if (++exp - Bias >= (1 << ExpBits) - 1) {
+            return DxbcTextScanResult::NumberOutOfRange;
+        }
+    }
+    if (!(mant & (1u << MantBits))) {
+        exp = Bias;
+    }
+    *out = sign | uint32_t(exp - Bias) << MantBits | (uint32_t(mant) & ((1u << MantBits) - 1));
+    return DxbcTextScanResult::Okay;
 }
 
+/*
+    [-+]?[0-9]*(\.[0-9]*)?([eE][-+]?[0-9]+)? with at least one digit, correctly rounded.
+
+    Fast path (Clinger): with up to 19 significant digits the mantissa w is exact in a uint64_t,
+    and if w < 2^53 and |e| <= 22, w and 10^e are both exact doubles, so w*10^e (or w/10^-e) is a
+    single correctly rounded double op. Rounding that to float again is only wrong if the double
+    landed exactly halfway between 2 floats, those (and float denormals) go to the slow path.
+    fxc listings print immediates like 0.500000 or 123.456001, which all take the fast path.
+*/
+static DxbcTextScanResult
+ParseFloat(const char **ppSrc, const char *pEnd, float *out)
+{
+    static const double Pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+
+    const char *const pStart = *ppSrc;
+    const char *p = pStart;
+    bool neg = false;
+    if (p != pEnd && (*p == '-' || *p == '+')) {
+        neg = *p++ == '-';
+    }
+    uint64_t w = 0;
+    int numSigDigits = 0;
+    int exp10 = 0;
+    bool truncated = false;
+    uint numDigits = 0;
+    for (; p != pEnd && IsDecimalDigit(ubyte(*p)); ++p, ++numDigits) {
+        uint const d = *p - '0';
+        if (numSigDigits < 19) {
+            w = w * 10 + d;
+            numSigDigits += w != 0;
+        }
+        else {
+            exp10++;
+            truncated |= d != 0;
+        }
+    }
+    if (p != pEnd && *p == '.') {
+        for (++p; p != pEnd && IsDecimalDigit(ubyte(*p)); ++p, ++numDigits) {
+            uint const d = *p - '0';
+            if (numSigDigits < 19) {
+                w = w * 10 + d;
+                numSigDigits += w != 0;
+                exp10--;
+            }
+            else {
+                truncated |= d != 0;
+            }
+        }
+    }
+    if (numDigits == 0) {
+        return DxbcTextScanResult::ExpectedNumber;
+    }
+    if (p != pEnd && (*p | 0x20) == 'e') {
+        // only an exponent if there are digits, "1.0e" is 1.0 followed by 'e':
+        const char *q = p + 1;
+        bool negExp = false;
+        if (q != pEnd && (*q == '-' || *q == '+')) {
+            negExp = *q++ == '-';
+        }
+        if (q != pEnd && IsDecimalDigit(ubyte(*q))) {
+            int e = 0;
+            for (; q != pEnd && IsDecimalDigit(ubyte(*q)); ++q) {
+                if (e < 10000) {
+                    e = e * 10 + (*q - '0');
+                }
+            }
+            exp10 += negExp ? -e : e;
+            p = q;
+        }
+    }
+
+    if (w == 0 && !truncated) {
+        *out = neg ? -0.0f : 0.0f;
+        *ppSrc = p;
+        return DxbcTextScanResult::Okay;
+    }
+    if (!truncated && w < (uint64_t(1) << 53) && exp10 >= -22 && exp10 <= 22) {
+        double const d = exp10 < 0 ? double(w) / Pow10[-exp10] : double(w) * Pow10[exp10];
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        // not a float denormal, and not exactly between 2 floats:
+        if (d >= FLT_MIN && (bits & 0x1fffffff) != 0x10000000) {
+            *out = neg ? -float(d) : float(d);
+            *ppSrc = p;
+            return DxbcTextScanResult::Okay;
+        }
+    }
+
+    SlowDecimal dec;
+    SlowDecimalFromText(&dec, pStart, p);
+    uint32_t bits;
+    DxbcTextScanResult const result = SlowDecimalToFloatBits(&dec, &bits);
+    if (result != DxbcTextScanResult::Okay) {
+        return result;
+    }
+    memcpy(out, &bits, sizeof(*out));
+    *ppSrc = p;
+    return DxbcTextScanResult::Okay;
+}
+
+static DxbcTextScanResult
+ScanInt32Bits(DxbcTextScanner *scanner, uint32_t *out)
+{
+    SkipWs(scanner);
+    return ParseInt32Bits(&scanner->pSrc, scanner->pEnd, out);
+}
+
+static DxbcTextScanResult
+ScanFloat(DxbcTextScanner *scanner, float *out)
+{
+    SkipWs(scanner);
+    return ParseFloat(&scanner->pSrc, scanner->pEnd, out);
+}
+
+static DxbcTextScanResult
+ScanDotWriteOrInputMask(DxbcTextScanner *scanner, uint *pWriteMask)
+{
+    SCAN_VERIFY(ScanChar(scanner) == '.', BadSyntax, "should have dot before writemask/swizzle");
+
+    ByteView maskStr;
+    SCAN_TRY(ScanCName(scanner, &maskStr), "expected writemask");
+    SCAN_VERIFY_AT(maskStr.Length() - 1u < 4u, maskStr.pbegin, BadOperand, "writemask should be 1 to 4 components");
+
+    uint swizzle;
+    SCAN_VERIFY_AT(DecodeCompString(maskStr, scanner->pEnd, &swizzle), maskStr.pbegin, BadOperand, "bad writemask");
+    *pWriteMask = WriteMaskOfCompString(swizzle, maskStr.Length());
+    SCAN_VERIFY_AT(*pWriteMask, maskStr.pbegin, BadOperand, "bad writemask");
+    return DxbcTextScanResult::Okay;
+}
+
+static DxbcTextScanResult
+ScanShaderModel(DxbcTextScanner *scanner)
+{
+    ByteView shaderModelString;
+    SCAN_TRY(ScanCName(scanner, &shaderModelString), "expected shader model");
+    SCAN_VERIFY_AT(EqualStrZ(shaderModelString, "cs_5_0"), shaderModelString.pbegin, Unsupported, "only cs_5_0 is supported");
+    return DxbcTextScanResult::Okay;
+}
+
+/*
+    Declarations are table-driven: a DxbcDeclSyntax row says which of these a dcl_* line has,
+    in this order:
+
+        dcl_name[(sampleCount)] [(returnType,x4)] [file#[[size]]] [, number]... [, keyword[.mask]]
+
+    Items after the register (or after the name, if there is none) are separated by commas.
+    ScanDeclOperands scans what the row says is there, StoreDeclaration checks the values and
+    keeps them in DxbcHeaderInfo. Headers are a few lines, so the table is searched linearly.
+*/
+enum {
+    DclShape_SampleCount = 1 << 0, // optional (n) right after the name
+    DclShape_ReturnTypes = 1 << 1,
+    DclShape_Register = 1 << 2, // of DxbcDeclSyntax::file
+    DclShape_RegisterSize = 1 << 3, // [n] after the register
+    DclShape_Keyword = 1 << 4, // one of DxbcDeclSyntax::keywords
+    DclShape_KeywordFlags = 1 << 5, // keywords joined by '|'
+    DclShape_ComponentMask = 1 << 6, // optional .mask after the keyword
+};
+
+static const char *const GlobalFlagNames[] = { // DXBC_GLOBAL_FLAG_* bit order
+    "refactoringAllowed", "enableDoublePrecisionFloatOps", "forceEarlyDepthStencil", "enableRawAndStructuredBuffers",
+    "skipOptimization", "enableMinimumPrecision", "enable11_1DoubleExtensions", "enable11_1ShaderExtensions", nullptr
+};
+static const char *const InputRegisterNames[] = {
+    "vThreadID", "vThreadGroupID", "vThreadIDInGroup", "vThreadIDInGroupFlattened", nullptr
+};
+static const char *const ConstantBufferAccessNames[] = { "immediateIndexed", "dynamicIndexed", nullptr };
+static const char *const SamplerModeNames[] = { "mode_default", "mode_comparison", "mode_mono", nullptr }; // DxbcSamplerMode order
+static const char *const ReturnTypeNames[] = { // DxbcReturnType order, after none
+    "unorm", "snorm", "sint", "uint", "float", "mixed", "double", "continued", nullptr
+};
 
-struct DxbcInstrStringInfo {
+struct DxbcDeclSyntax {
     const char *name;
-    // uint8_t nameLength;
+    uint8_t nameLength;
     DxbcInstrTag instrTag;
-    DxbcInstrClass instrClass;
+    DxbcResourceDim dim;
+    uint8_t shape; // DclShape_*
+    uint8_t numNumbers;
+    const char *file; // lower case, "cb0" and "CB0" are both fine
+    const char *const *keywords;
 };
 
-// todo: use hashmap
-static const DxbcInstrStringInfo StringTable[] = {
-    { "dcl_globalFlags",        DxbcInstrTag::dcl_globalFlags,       DxbcInstrClass::misc_outside_function_body },
-    { "dcl_uav_typed_buffer",   DxbcInstrTag::dcl_uav_typed_buffer,  DxbcInstrClass::misc_outside_function_body },
-    { "dcl_input",              DxbcInstrTag::dcl_input,             DxbcInstrClass::misc_outside_function_body },
-    { "dcl_temps",              DxbcInstrTag::dcl_temps,             DxbcInstrClass::misc_outside_function_body },
-    { "dcl_thread_group",       DxbcInstrTag::dcl_thread_group,      DxbcInstrClass::misc_outside_function_body },
-    // ...
-    { "ret",                    DxbcInstrTag::ret,                   DxbcInstrClass::misc_in_function_body },
-    { "endif",                  DxbcInstrTag::endif,                 DxbcInstrClass::misc_in_function_body },
-    { "else",                   DxbcInstrTag::_else,                 DxbcInstrClass::misc_in_function_body },
-    { "ld_uav_typed",           DxbcInstrTag::ld_uav_typed,          DxbcInstrClass::misc_in_function_body },
-    { "ld_uav_typed_indexable", DxbcInstrTag::ld_uav_typed,          DxbcInstrClass::misc_in_function_body },
-    // ...
-    { "mov",                    DxbcInstrTag::mov,                   DxbcInstrClass::dst0_assign_unary_op },
-    { "not",/*no 'i' in str*/   DxbcInstrTag::inot,                  DxbcInstrClass::dst0_assign_unary_op },
-    // ...
-    { "and", /*no 'i' in str*/  DxbcInstrTag::iand,                  DxbcInstrClass::dst0_assign_binary_op },
-    { "xor", /*no 'i' in str*/  DxbcInstrTag::ixor,                  DxbcInstrClass::dst0_assign_binary_op },
-    { "or", /*no 'i' in str*/   DxbcInstrTag::ior,                   DxbcInstrClass::dst0_assign_binary_op },
-    { "ishl",                   DxbcInstrTag::ishl,                  DxbcInstrClass::dst0_assign_binary_op },
-    { "iadd",                   DxbcInstrTag::iadd,                  DxbcInstrClass::dst0_assign_binary_op },
-    { "add",                    DxbcInstrTag::add,                   DxbcInstrClass::dst0_assign_binary_op },
-    { "store_uav_typed",        DxbcInstrTag::store_uav_typed,       DxbcInstrClass::dst0_assign_binary_op },
-    { "ult",                    DxbcInstrTag::ult,                   DxbcInstrClass::dst0_assign_binary_op },
-    { "uge",                    DxbcInstrTag::uge,                   DxbcInstrClass::dst0_assign_binary_op },
-    { "ieq",                    DxbcInstrTag::ieq,                   DxbcInstrClass::dst0_assign_binary_op },
-    // ...
-    { "movc",                   DxbcInstrTag::movc,                  DxbcInstrClass::dst0_assign_tri_op },
-    { "imad",                   DxbcInstrTag::imad,                  DxbcInstrClass::dst0_assign_tri_op },
+#define DECL_TABLE_ENTRY(str, tag, dim, shape, numNumbers, file, keywords) \
+    { str, ConstStrLen(str), DxbcInstrTag::tag, DxbcResourceDim::dim, shape, numNumbers, file, keywords }
+
+enum : uint8_t {
+    DclTypedResource = DclShape_ReturnTypes | DclShape_Register,
+    DclMultisampledResource = DclShape_SampleCount | DclShape_ReturnTypes | DclShape_Register,
 };
 
-static const DxbcInstrStringInfo *
-LookupInstrInfo(ByteView view)
-{
-    for (const DxbcInstrStringInfo& info : StringTable) {
-        if (EqualStrZ(view, info.name)) {
-            return &info;
-        }
-    }
-    return nullptr;
-}
+static const DxbcDeclSyntax DeclSyntaxTable[] = {
+    DECL_TABLE_ENTRY("dcl_globalFlags",                  dcl_globalFlags,         unknown,          DclShape_KeywordFlags,                       0, nullptr, GlobalFlagNames),
+    DECL_TABLE_ENTRY("dcl_input",                        dcl_input,               unknown,          DclShape_Keyword | DclShape_ComponentMask,   0, nullptr, InputRegisterNames),
+    DECL_TABLE_ENTRY("dcl_temps",                        dcl_temps,               unknown,          0,                                           1, nullptr, nullptr),
+    DECL_TABLE_ENTRY("dcl_thread_group",                 dcl_thread_group,        unknown,          0,                                           3, nullptr, nullptr),
+    DECL_TABLE_ENTRY("dcl_constantbuffer",               dcl_constantbuffer,      unknown,          DclShape_Register | DclShape_RegisterSize | DclShape_Keyword, 0, "cb", ConstantBufferAccessNames),
+    DECL_TABLE_ENTRY("dcl_sampler",                      dcl_sampler,             unknown,          DclShape_Register | DclShape_Keyword,        0, "s",     SamplerModeNames),
+    DECL_TABLE_ENTRY("dcl_resource_buffer",              dcl_resource,            buffer,           DclTypedResource,                            0, "t",     nullptr),
+    DECL_TABLE_ENTRY("dcl_resource_texture1d",           dcl_resource,            texture1d,        DclTypedResource,                            0, "t",     nullptr),
+    DECL_TABLE_ENTRY("dcl_resource_texture2d",           dcl_resource,            texture2d,        DclTypedResource,                            0, "t",     nullptr),
+    DECL_TABLE_ENTRY("dcl_resource_texture2dms",         dcl_resource,            texture2dms,      DclMultisampledResource,                     0, "t",     nullptr),
+    DECL_TABLE_ENTRY("dcl_resource_texture3d",           dcl_resource,            texture3d,        DclTypedResource,                            0, "t",     nullptr),
+    DECL_TABLE_ENTRY("dcl_resource_texturecube",         dcl_resource,            texturecube,      DclTypedResource,                            0, "t",     nullptr),
+    DECL_TABLE_ENTRY("dcl_resource_texture1darray",      dcl_resource,            texture1darray,   DclTypedResource,                            0, "t",     nullptr),
+    DECL_TABLE_ENTRY("dcl_resource_texture2darray",      dcl_resource,            texture2darray,   DclTypedResource,                            0, "t",     nullptr),
+    DECL_TABLE_ENTRY("dcl_resource_texture2dmsarray",    dcl_resource,            texture2dmsarray, DclMultisampledResource,                     0, "t",     nullptr),
+    DECL_TABLE_ENTRY("dcl_resource_texturecubearray",    dcl_resource,            texturecubearray, DclTypedResource,                            0, "t",     nullptr),
+    DECL_TABLE_ENTRY("dcl_resource_raw",                 dcl_resource_raw,        raw,              DclShape_Register,                           0, "t",     nullptr),
+    DECL_TABLE_ENTRY("dcl_resource_structured",          dcl_resource_structured, structured,       DclShape_Register,                           1, "t",     nullptr),
+    DECL_TABLE_ENTRY("dcl_uav_typed_buffer",             dcl_uav_typed,           buffer,           DclTypedResource,                            0, "u",     nullptr),
+    DECL_TABLE_ENTRY("dcl_uav_typed_texture1d",          dcl_uav_typed,           texture1d,        DclTypedResource,                            0, "u",     nullptr),
+    DECL_TABLE_ENTRY("dcl_uav_typed_texture2d",          dcl_uav_typed,           texture2d,        DclTypedResource,                            0, "u",     nullptr),
+    DECL_TABLE_ENTRY("dcl_uav_typed_texture3d",          dcl_uav_typed,           texture3d,        DclTypedResource,                            0, "u",     nullptr),
+    DECL_TABLE_ENTRY("dcl_uav_typed_texture1darray",     dcl_uav_typed,           texture1darray,   DclTypedResource,                            0, "u",     nullptr),
+    DECL_TABLE_ENTRY("dcl_uav_typed_texture2darray",     dcl_uav_typed,           texture2darray,   DclTypedResource,                            0, "u",     nullptr),
+    DECL_TABLE_ENTRY("dcl_uav_raw",                      dcl_uav_raw,             raw,              DclShape_Register,                           0, "u",     nullptr),
+    DECL_TABLE_ENTRY("dcl_uav_structured",               dcl_uav_structured,      structured,       DclShape_Register,                           1, "u",     nullptr),
+    DECL_TABLE_ENTRY("dcl_tgsm_raw",                     dcl_tgsm_raw,            unknown,          DclShape_Register,                           1, "g",     nullptr),
+    DECL_TABLE_ENTRY("dcl_tgsm_structured",              dcl_tgsm_structured,     unknown,          DclShape_Register,                           2, "g",     nullptr),
+    DECL_TABLE_ENTRY("dcl_indexableTemp",                dcl_indexableTemp,       unknown,          DclShape_Register | DclShape_RegisterSize,   1, "x",     nullptr),
+};
 
+#undef DECL_TABLE_ENTRY
 
-static const char *
-SkipWs(const char *p)
+// dcl_uav_raw_glc u0 is dcl_uav_raw with DxbcResourceFlag_GloballyCoherent:
+static const DxbcDeclSyntax *
+LookupDeclSyntax(ByteView name, uint *pResourceFlags)
 {
-    for (;; ++p) {
-        char const c = *p;
-        if (!(c == ' ' || c == '\n' || c == '\r' || c == '\t'))
-            break;
+    *pResourceFlags = 0;
+    for (;;) {
+        for (const DxbcDeclSyntax& syntax : DeclSyntaxTable) {
+            if (syntax.nameLength == name.Length() && memcmp(name.pbegin, syntax.name, syntax.nameLength) == 0) {
+                // _glc only goes on uavs, _opc only on structured ones:
+                bool const isUav = syntax.file && syntax.file[0] == 'u';
+                bool const isStructuredUav = syntax.instrTag == DxbcInstrTag::dcl_uav_structured;
+                if ((*pResourceFlags && !isUav) || ((*pResourceFlags & DxbcResourceFlag_OrderPreservingCounter) && !isStructuredUav)) {
+                    return nullptr;
+                }
+                return &syntax;
+            }
+        }
+        ByteView const suffix = { name.pend - Min<ptrdiff_t>(4, name.pend - name.pbegin), name.pend };
+        if (EqualStrZ(suffix, "_glc") && !(*pResourceFlags & DxbcResourceFlag_GloballyCoherent)) {
+            *pResourceFlags |= DxbcResourceFlag_GloballyCoherent;
+        }
+        else if (EqualStrZ(suffix, "_opc") && !(*pResourceFlags & DxbcResourceFlag_OrderPreservingCounter)) {
+            *pResourceFlags |= DxbcResourceFlag_OrderPreservingCounter;
+        }
+        else {
+            return nullptr;
+        }
+        name.pend -= 4;
     }
-    return p;
 }
 
-static void
-SkipWs(DxbcTextScanner *scanner)
+static bool
+FindKeyword(ByteView word, const char *const *keywords, uint *pIndex)
 {
-    scanner->pSrc = SkipWs(scanner->pSrc);
+    for (uint i = 0; keywords[i]; ++i) {
+        if (EqualStrZ(word, keywords[i])) {
+            *pIndex = i;
+            return true;
+        }
+    }
+    return false;
 }
 
-static bool IsAlphaOrUnderscore(uint c)
+// t12, cb0, CB0, ...
+static bool
+ParseRegister(ByteView reg, const char *file, uint32_t *pIndex)
 {
-    return ((c | 32u) - 'a') < 26u || c == '_';
+    const char *p = reg.pbegin;
+    for (; *file; ++file, ++p) {
+        if (p == reg.pend || (ubyte(*p) | 0x20u) != ubyte(*file)) {
+            return false;
+        }
+    }
+    if (p == reg.pend || reg.pend - p > 6) {
+        return false;
+    }
+    uint32_t index = 0;
+    for (; p != reg.pend; ++p) {
+        uint const d = ubyte(*p) - '0';
+        if (d >= 10u) {
+            return false;
+        }
+        index = index * 10 + d;
+    }
+    *pIndex = index;
+    return true;
 }
 
-static uint LetterToCompIndex(uint ch)
-{
-    return ((ch | 32u) - 'w' - 1) & 3u;
-}
+struct DclOperands {
+    uint32_t sampleCount;
+    DxbcReturnType returnTypes[4];
+    uint32_t reg;
+    uint32_t regSize;
+    uint32_t numbers[3];
+    uint keyword; // index into DxbcDeclSyntax::keywords, a mask of them for DclShape_KeywordFlags
+    uint componentMask;
+    // for the errors of StoreDeclaration:
+    const char *pReg;
+    const char *pRegSize;
+    const char *pNumbers[3];
+    const char *pKeyword;
+};
 
 static DxbcTextScanResult
-ScanCName(DxbcTextScanner *scanner, ByteView *out)
+ScanDeclOperands(DxbcTextScanner *scanner, const DxbcDeclSyntax& syntax, DclOperands *ops)
 {
-    const char *p = SkipWs(scanner->pSrc);
-    out->pbegin = p;
-    out->pend = p;
-    scanner->pSrc = p;
-    uint c = *p;
-    if (c == 0) {
-        return DxbcTextScanResult::Eof;
+    *ops = {};
+    ops->pReg = ops->pRegSize = ops->pKeyword = scanner->pSrc;
+
+    if ((syntax.shape & DclShape_SampleCount) && PeekChar(scanner) == '(') { // dcl_resource_texture2dms(4)
+        scanner->pSrc++;
+        SCAN_TRY(ScanInt32Bits(scanner, &ops->sampleCount), "expected sample count");
+        SCAN_VERIFY(ops->sampleCount <= 32u, NumberOutOfRange, "sample count should be 0 to 32");
+        SCAN_VERIFY(ScanChar(scanner) == ')', BadSyntax, "expected ')' after sample count");
     }
-    if (!IsAlphaOrUnderscore(c)) {
-        return DxbcTextScanResult::ExpectedAlpha;
+    if (syntax.shape & DclShape_ReturnTypes) { // (float,float,float,float)
+        SCAN_VERIFY(ScanChar(scanner) == '(', BadSyntax, "expected '(' before return types");
+        for (uint i = 0; i < 4; ++i) {
+            SCAN_VERIFY(i == 0 || ScanChar(scanner) == ',', BadSyntax, "expected ',' between return types");
+            ByteView typeName;
+            uint type;
+            SCAN_TRY(ScanCName(scanner, &typeName), "expected return type");
+            SCAN_VERIFY_AT(FindKeyword(typeName, ReturnTypeNames, &type), typeName.pbegin, Unsupported, "unknown return type");
+            ops->returnTypes[i] = DxbcReturnType(type + 1);
+        }
+        SCAN_VERIFY(ScanChar(scanner) == ')', BadSyntax, "expected ')' after return types");
+    }
+
+    bool needsComma = false;
+    if (syntax.shape & DclShape_Register) {
+        ByteView reg;
+        SCAN_TRY(ScanCName(scanner, &reg), "expected register");
+        SCAN_VERIFY_AT(ParseRegister(reg, syntax.file, &ops->reg), reg.pbegin, BadOperand, "wrong register for this declaration");
+        ops->pReg = reg.pbegin;
+        if (syntax.shape & DclShape_RegisterSize) {
+            SCAN_VERIFY(PeekChar(scanner) == '[', BadSyntax, "expected '[' after register");
+            scanner->pSrc++;
+            ops->pRegSize = SkipWs(scanner->pSrc, scanner->pEnd);
+            SCAN_TRY(ScanInt32Bits(scanner, &ops->regSize), "expected register size");
+            SCAN_VERIFY(ScanChar(scanner) == ']', BadSyntax, "expected ']' after register size");
+        }
+        needsComma = true;
+    }
+    for (uint i = 0; i < syntax.numNumbers; ++i) {
+        SCAN_VERIFY(!needsComma || ScanChar(scanner) == ',', BadSyntax, "expected ','");
+        ops->pNumbers[i] = SkipWs(scanner->pSrc, scanner->pEnd);
+        SCAN_TRY(ScanInt32Bits(scanner, &ops->numbers[i]), "expected number");
+        needsComma = true;
+    }
+    if (syntax.shape & (DclShape_Keyword | DclShape_KeywordFlags)) {
+        SCAN_VERIFY(!needsComma || ScanChar(scanner) == ',', BadSyntax, "expected ','");
+        for (;;) {
+            ByteView word;
+            uint k;
+            SCAN_TRY(ScanCName(scanner, &word), "expected keyword");
+            SCAN_VERIFY_AT(FindKeyword(word, syntax.keywords, &k), word.pbegin, Unsupported, "unsupported in this declaration");
+            if (!(syntax.shape & DclShape_KeywordFlags)) {
+                ops->keyword = k;
+                ops->pKeyword = word.pbegin;
+                break;
+            }
+            ops->keyword |= 1u << k;
+            SkipWs(scanner);
+            if (PeekChar(scanner) != '|') {
+                break;
+            }
+            scanner->pSrc++;
+        }
+        if ((syntax.shape & DclShape_ComponentMask) && PeekChar(scanner) == '.') {
+            DxbcTextScanResult const maskResult = ScanDotWriteOrInputMask(scanner, &ops->componentMask);
+            if (maskResult != DxbcTextScanResult::Okay) {
+                return maskResult;
+            }
+        }
     }
-    do c = *++p; while (IsAlphaOrUnderscore(c) || c - '0' < 10u);
-    out->pend = p;
-    scanner->pSrc = p;
     return DxbcTextScanResult::Okay;
 }
 
-static uint
-ScanChar(DxbcTextScanner *scanner)
+static bool
+TestAndSetBit(uint64_t *pMask, uint i)
 {
-    const char *p = SkipWs(scanner->pSrc);
-    scanner->pSrc = *p == 0 ? p : (p + 1);
-    return *p;
+    uint64_t const bit = uint64_t(1) << i;
+    bool const wasSet = (*pMask & bit) != 0;
+    *pMask |= bit;
+    return wasSet;
 }
 
-static void
-Verify(bool cond, const char *str="")
+static DxbcTextScanResult
+StoreDeclaration(DxbcTextScanner *scanner, const DxbcDeclSyntax& syntax, uint resourceFlags, const DclOperands& ops,
+                 DxbcHeaderInfo *headerInfo)
 {
-    if (!cond) {
-        fprintf(stderr, "VerifyFailed: %s\n", str);
-#ifdef _MSC_VER
-        __debugbreak();
-#else
-        exit(43);
-#endif
+    switch (syntax.instrTag) {
+    case DxbcInstrTag::dcl_globalFlags: { // dcl_globalFlags refactoringAllowed
+        headerInfo->globalFlags |= uint8_t(ops.keyword);
+    } break;
+    case DxbcInstrTag::dcl_temps: { // dcl_temps 1
+        SCAN_VERIFY_AT(ops.numbers[0] - 1u < 4096u, ops.pNumbers[0], NumberOutOfRange, "dcl_temps should be 1 to 4096");
+        headerInfo->numTemps = uint16_t(ops.numbers[0]);
+    } break;
+    case DxbcInstrTag::dcl_input: { // dcl_input vThreadID.x
+        uint8_t *const usedMasks[] = {
+            &headerInfo->vThreadID_usedMask, &headerInfo->vThreadGroupID_usedMask, &headerInfo->vThreadIDInGroup_usedMask
+        };
+        if (ops.keyword == lengthof(usedMasks)) { // vThreadIDInGroupFlattened
+            SCAN_VERIFY_AT(!ops.componentMask, ops.pKeyword, BadOperand, "vThreadIDInGroupFlattened has no components");
+            headerInfo->vThreadIDInGroupFlattened = true;
+        }
+        else {
+            SCAN_VERIFY_AT(ops.componentMask, ops.pKeyword, BadOperand, "expected a mask of the used components");
+            *usedMasks[ops.keyword] |= uint8_t(ops.componentMask);
+        }
+    } break;
+    case DxbcInstrTag::dcl_thread_group: { // dcl_thread_group 64, 1, 1
+        int *const sizes[3] = { &headerInfo->workgroupSize.x, &headerInfo->workgroupSize.y, &headerInfo->workgroupSize.z };
+        for (uint i = 0; i < 3; ++i) {
+            SCAN_VERIFY_AT(ops.numbers[i] - 1u < 1024u, ops.pNumbers[i], NumberOutOfRange, "thread group size should be 1 to 1024");
+            *sizes[i] = int(ops.numbers[i]);
+        }
+    } break;
+    case DxbcInstrTag::dcl_constantbuffer: { // dcl_constantbuffer cb0[4], immediateIndexed
+        SCAN_VERIFY_AT(ops.reg < DXBC_MAX_CONSTANT_BUFFERS, ops.pReg, NumberOutOfRange, "constant buffer register out of range");
+        SCAN_VERIFY_AT(ops.regSize - 1u < 4096u, ops.pRegSize, NumberOutOfRange, "constant buffer should be 1 to 4096 vec4s");
+        uint64_t mask = headerInfo->constantBufferDeclMask;
+        SCAN_VERIFY_AT(!TestAndSetBit(&mask, ops.reg), ops.pReg, BadOperand, "register declared twice");
+        headerInfo->constantBufferDeclMask = uint16_t(mask);
+        headerInfo->constantBuffers[ops.reg] = { uint16_t(ops.regSize), ops.keyword == 1 };
+    } break;
+    case DxbcInstrTag::dcl_sampler: { // dcl_sampler s0, mode_default
+        SCAN_VERIFY_AT(ops.reg < DXBC_MAX_SAMPLERS, ops.pReg, NumberOutOfRange, "sampler register out of range");
+        uint64_t mask = headerInfo->samplerDeclMask;
+        SCAN_VERIFY_AT(!TestAndSetBit(&mask, ops.reg), ops.pReg, BadOperand, "register declared twice");
+        headerInfo->samplerDeclMask = uint16_t(mask);
+        headerInfo->samplerModes[ops.reg] = DxbcSamplerMode(ops.keyword);
+    } break;
+    case DxbcInstrTag::dcl_resource: // dcl_resource_texture2d (float,float,float,float) t0
+    case DxbcInstrTag::dcl_resource_raw: // dcl_resource_raw t0
+    case DxbcInstrTag::dcl_resource_structured: // dcl_resource_structured t0, 16
+    case DxbcInstrTag::dcl_uav_typed: // dcl_uav_typed_buffer (uint,uint,uint,uint) u0
+    case DxbcInstrTag::dcl_uav_raw: // dcl_uav_raw u0
+    case DxbcInstrTag::dcl_uav_structured: { // dcl_uav_structured u0, 4
+        bool const isUav = syntax.file[0] == 'u';
+        SCAN_VERIFY_AT(ops.reg < (isUav ? uint(DXBC_MAX_UAVS) : uint(DXBC_MAX_RESOURCES)), ops.pReg, NumberOutOfRange,
+                       "resource register out of range");
+        bool const isStructured = syntax.dim == DxbcResourceDim::structured;
+        SCAN_VERIFY_AT(!isStructured || (ops.numbers[0] && ops.numbers[0] % 4u == 0 && ops.numbers[0] <= 2048u), ops.pNumbers[0],
+                       NumberOutOfRange, "structure stride should be a multiple of 4 up to 2048");
+        uint64_t *const pMask = isUav ? &headerInfo->uavDeclMask : &headerInfo->resourceDeclMask[ops.reg / 64];
+        SCAN_VERIFY_AT(!TestAndSetBit(pMask, ops.reg % 64), ops.pReg, BadOperand, "register declared twice");
+        DxbcResourceDecl& decl = isUav ? headerInfo->uavs[ops.reg] : headerInfo->resources[ops.reg];
+        decl.dim = syntax.dim;
+        decl.flags = uint8_t(resourceFlags);
+        decl.sampleCount = uint8_t(ops.sampleCount);
+        memcpy(decl.returnTypes, ops.returnTypes, sizeof decl.returnTypes);
+        decl.stride = isStructured ? ops.numbers[0] : 0;
+    } break;
+    case DxbcInstrTag::dcl_tgsm_raw: // dcl_tgsm_raw g0, 1024
+    case DxbcInstrTag::dcl_tgsm_structured: { // dcl_tgsm_structured g0, 4, 256
+        SCAN_VERIFY_AT(ops.reg < DXBC_MAX_TGSMS, ops.pReg, NumberOutOfRange, "tgsm register out of range");
+        bool const isStructured = syntax.instrTag == DxbcInstrTag::dcl_tgsm_structured;
+        uint32_t const stride = isStructured ? ops.numbers[0] : 0;
+        SCAN_VERIFY_AT(!isStructured || (stride && stride % 4u == 0 && stride <= 32768u), ops.pNumbers[0], NumberOutOfRange,
+                       "structure stride should be a multiple of 4 up to 32768");
+        uint32_t const count = ops.numbers[isStructured];
+        uint64_t const numBytes = isStructured ? uint64_t(stride) * count : count;
+        SCAN_VERIFY_AT(numBytes && numBytes % 4u == 0 && numBytes <= 32768u, ops.pNumbers[isStructured], NumberOutOfRange,
+                       "tgsm should be a multiple of 4 bytes up to 32768");
+        uint64_t mask = headerInfo->tgsmDeclMask;
+        SCAN_VERIFY_AT(!TestAndSetBit(&mask, ops.reg), ops.pReg, BadOperand, "register declared twice");
+        headerInfo->tgsmDeclMask = uint32_t(mask);
+        headerInfo->tgsms[ops.reg] = { stride, uint32_t(numBytes) };
+    } break;
+    case DxbcInstrTag::dcl_indexableTemp: { // dcl_indexableTemp x0[16], 4
+        SCAN_VERIFY_AT(ops.reg < DXBC_MAX_INDEXABLE_TEMPS, ops.pReg, NumberOutOfRange, "indexable temp register out of range");
+        SCAN_VERIFY_AT(ops.regSize - 1u < 4096u, ops.pRegSize, NumberOutOfRange, "indexable temp should be 1 to 4096 registers");
+        SCAN_VERIFY_AT(ops.numbers[0] - 1u < 4u, ops.pNumbers[0], NumberOutOfRange, "indexable temp should have 1 to 4 components");
+        uint64_t mask = headerInfo->indexableTempDeclMask;
+        SCAN_VERIFY_AT(!TestAndSetBit(&mask, ops.reg), ops.pReg, BadOperand, "register declared twice");
+        headerInfo->indexableTempDeclMask = uint32_t(mask);
+        headerInfo->indexableTemps[ops.reg] = { ops.regSize, uint8_t(ops.numbers[0]) };
+    } break;
+    default: {
+        ASSERT(0);
+        unreachable;
+    } break;
     }
+    return DxbcTextScanResult::Okay;
 }
 
-static void attrib_noreturn Panic(const char *str, int line)
+/*
+    Scans one dcl_* line into headerInfo.
+    Sets *pEndOfHeader instead at the end of the text, or when the next word isn't a declaration (pSrc is left before it).
+**/
+static DxbcTextScanResult
+ScanDeclaration(DxbcTextScanner *scanner, DxbcHeaderInfo *headerInfo, bool *pEndOfHeader)
 {
-    fprintf(stderr, "line:%d, failed VERIFY(%s)\n", line, str);
-#ifdef _MSC_VER
-        __debugbreak();
-#else
-        exit(43);
-#endif
-}
-
-#define VERIFY(e) ((e) ? (void)0 : Panic(#e, __LINE__));
+    *pEndOfHeader = false;
 
-static uint
-ScanDotWriteOrInputMask(DxbcTextScanner *scanner)
-{
-    char const shouldBeDot = ScanChar(scanner);
-    Verify(shouldBeDot == '.', "should have dot before writemask/sizzle");
+    ByteView firstStr;
+    DxbcTextScanResult const result = ScanCName(scanner, &firstStr);
+    if (result == DxbcTextScanResult::Eof) {
+        *pEndOfHeader = true; // only declarations
+        return DxbcTextScanResult::Okay;
+    }
+    SCAN_TRY(result, "expected a declaration or instruction");
+    // the body scanner reports unknown instructions:
+    if (!StartsWith(firstStr, "dcl_"_view)) {
+        scanner->pSrc = firstStr.pbegin; // backup
+        *pEndOfHeader = true;
+        return DxbcTextScanResult::Okay;
+    }
 
-    ByteView maskStr;
-    DxbcTextScanResult maskRes = ScanCName(scanner, &maskStr);
-    VERIFY(maskRes == DxbcTextScanResult::Okay);
-    VERIFY(maskStr.Length() - 1u < 4u);
+    uint resourceFlags;
+    const DxbcDeclSyntax *const syntax = LookupDeclSyntax(firstStr, &resourceFlags);
+    SCAN_VERIFY_AT(syntax, firstStr.pbegin, Unsupported, "unsupported declaration");
 
-    uint writeMask = 0;
-    for (char ch : maskStr) {
-        uint comp = LetterToCompIndex(ch);
-        VERIFY(comp < 4u);
-        Verify(!(writeMask & 1u << comp), "bad writemask");
-        writeMask |= 1u << comp;
+    DclOperands ops;
+    DxbcTextScanResult const operandsResult = ScanDeclOperands(scanner, *syntax, &ops);
+    if (operandsResult != DxbcTextScanResult::Okay) {
+        return operandsResult;
     }
-    return writeMask;
+    return StoreDeclaration(scanner, *syntax, resourceFlags, ops, headerInfo);
 }
 
 DxbcTextScanResult
@@ -203,84 +1337,18 @@ DxbcText_ScanHeader(DxbcTextScanner *scanner, DxbcHeaderInfo *headerInfo)
 {
     *headerInfo = { };
 
-    {
-        ByteView shaderModelString;
-        DxbcTextScanResult result = ScanCName(scanner, &shaderModelString);
-        if (result != DxbcTextScanResult::Okay) {
-            return result;
-        }
-        VERIFY(EqualStrZ(shaderModelString, "cs_5_0"));
-    }
-
-    for (;;) {
-        ByteView firstStr;
-        VERIFY(ScanCName(scanner, &firstStr) == DxbcTextScanResult::Okay);
-        const DxbcInstrStringInfo *const info = LookupInstrInfo(firstStr);
-        if (!info) {
-            Println(stderr, "unknown instruction: ", firstStr);
-            return DxbcTextScanResult::UnknownInstruction;
-        }
-        if (info->instrClass != DxbcInstrClass::misc_outside_function_body) {
-            scanner->pSrc = firstStr.pbegin; // backup
-            break;
-        }
-        switch (info->instrTag) {
-            case DxbcInstrTag::dcl_globalFlags: { // dcl_globalFlags refactoringAllowed
-                ByteView name; ScanCName(scanner, &name);
-                VERIFY(EqualStrZ(name, "refactoringAllowed"));
-                headerInfo->globalFlags |= DXBC_GLOBAL_FLAG_REFACTORING_ALLOWED;
-            } break;
-            case DxbcInstrTag::dcl_temps: { // dcl_temps 1
-                unsigned long numV4s = strtol(scanner->pSrc, const_cast<char **>(&scanner->pSrc), 0);
-                ASSERT(errno == 0);
-                ASSERT(numV4s - 1u < 4096u);
-                headerInfo->numTemps = uint16_t(numV4s);
-            } break;
-            case DxbcInstrTag::dcl_input: { // dcl_input vThreadID.x
-                ByteView name; ScanCName(scanner, &name);
-                if (EqualStrZ(name, "vThreadIDInGroupFlattened")) {
-                    headerInfo->vThreadIDInGroupFlattened = true;
-                }
-                else {
-                    uint mask = ScanDotWriteOrInputMask(scanner);
-                    if (EqualStrZ(name, "vThreadID")) {
-                        headerInfo->vThreadID_usedMask |= mask;
-                    }
-                    else {
-                        VERIFY(0);
-                    }
-                }
-            } break;
-            case DxbcInstrTag::dcl_thread_group: { // dcl_thread_group 64, 1, 1
-                int nBytesAdvance = 0;
-                int nIntsGot = sscanf(scanner->pSrc, "%d,%d,%d%n", &headerInfo->workgroupSize.x, &headerInfo->workgroupSize.y, &headerInfo->workgroupSize.z, &nBytesAdvance);
-                VERIFY(nIntsGot == 3);
-                scanner->pSrc += nBytesAdvance;
-            } break;
-            case DxbcInstrTag::dcl_uav_typed_buffer: { // dcl_uav_typed_buffer (sint,sint,sint,sint) u0
-                puts("TODO: skippiong to end of line, assuming this is like { RWBuffer<int> myUav : register(u0); }");
-                const char *p = scanner->pSrc;
-                while (*p != '\n' && *p != 0) ++p;
-                scanner->pSrc = p;
-            } break;
-            default: {
-                ASSERT(0);
-                unreachable;
-            } break;
-        }
+    DxbcTextScanResult result = ScanShaderModel(scanner);
+    for (bool endOfHeader = false; result == DxbcTextScanResult::Okay && !endOfHeader; ) {
+        result = ScanDeclaration(scanner, headerInfo, &endOfHeader);
     }
-
-    return DxbcTextScanResult::Okay;
+    return result;
 }
 
 DxbcTextScanResult
-DxbcText_ScanInstrInFuncBody(DxbcTextScanner *scanner, DxbcInstruction *instr)
+DxbcText_ScanInstrInFuncBody(DxbcTextScanner *scanner, DxbcInstruction *instr, Array<DxbcImmediate> *immediates)
 {
     ByteView firstStr;
-    DxbcTextScanResult result = ScanCName(scanner, &firstStr);
-    if (result != DxbcTextScanResult::Okay) {
-        return result;
-    }
+    SCAN_TRY(ScanCName(scanner, &firstStr), "expected an instruction");
 
     *instr = {};
 
@@ -301,7 +1369,7 @@ DxbcText_ScanInstrInFuncBody(DxbcTextScanner *scanner, DxbcInstruction *instr)
                 // ...
             }
             else {
-                VERIFY(0);
+                return ScanError(scanner, firstStr.pbegin, DxbcTextScanResult::UnknownInstruction, "expected if_nz or if_z");
             }
 
             numDests = 0;
@@ -312,10 +1380,9 @@ DxbcText_ScanInstrInFuncBody(DxbcTextScanner *scanner, DxbcInstruction *instr)
         }
         else {
             const DxbcInstrStringInfo * info = LookupInstrInfo(firstStr);
-
             if (!info) {
-                Println(stderr, "unknown instruction: ", firstStr);
-                return DxbcTextScanResult::UnknownInstruction;
+                SCAN_VERIFY_AT(!StartsWith(firstStr, "dcl_"_view), firstStr.pbegin, BadSyntax, "declaration after the first instruction");
+                return ScanError(scanner, firstStr.pbegin, DxbcTextScanResult::UnknownInstruction, "unknown instruction");
             }
 
             numDests = 1;
@@ -330,8 +1397,8 @@ DxbcText_ScanInstrInFuncBody(DxbcTextScanner *scanner, DxbcInstruction *instr)
                 if (EqualStrZ(firstStr, "ld_uav_typed_indexable")) {
                     // TODO:
                     const char *p = scanner->pSrc;
-                    while (*p != '\0' && *p != ')') { ++p; } if (*p == ')') { ++p; }
-                    while (*p != '\0' && *p != ')') { ++p; } if (*p == ')') { ++p; }
+                    while (p != scanner->pEnd && *p != ')') { ++p; } if (p != scanner->pEnd) { ++p; }
+                    while (p != scanner->pEnd && *p != ')') { ++p; } if (p != scanner->pEnd) { ++p; }
                     scanner->pSrc = p;
                 }
             }
@@ -340,7 +1407,20 @@ DxbcText_ScanInstrInFuncBody(DxbcTextScanner *scanner, DxbcInstruction *instr)
             case DxbcInstrTag::ret:
             case DxbcInstrTag::_else:
             case DxbcInstrTag::endif:
+            case DxbcInstrTag::loop:
+            case DxbcInstrTag::endloop:
+            case DxbcInstrTag::break_:
+            case DxbcInstrTag::continue_:
                 return DxbcTextScanResult::Okay;
+            case DxbcInstrTag::breakc:
+            case DxbcInstrTag::continuec:
+                // breakc_nz r0.x, the _z spellings are the same tag without the flag
+                if (firstStr.pend[-2] == 'n') {
+                    instr->flags |= DxbcInstrFlag_nz;
+                }
+                numDests = 0;
+                numSrcs = 1;
+                break;
             default:
                 break;
             }
@@ -348,33 +1428,26 @@ DxbcText_ScanInstrInFuncBody(DxbcTextScanner *scanner, DxbcInstruction *instr)
     }
 
     const int numTotalOperands = numDests + numSrcs;
+    instr->numOperands = uint8_t(numTotalOperands);
 
     int srcSwizzleCharLen = -1;
     int writeMaskCharLen = -1;
     uint writeMaskBits = 0;
 
     for (int argIndex = 0;;) {
-        // debug:
-        for (uint c = 0; c < 4; ++c) {
-            instr->operands[argIndex].immediateValue.u[c] = 0xdead0000u | c;
-        }
-
         uint operandFlags = 0;
         SkipWs(scanner);
-        if (scanner->pSrc[0] == '-') {
+        if (PeekChar(scanner) == '-') {
             scanner->pSrc++;
             operandFlags |= DxbcOperandFlag_SrcNeg;
         }
-        if (scanner->pSrc[0] == '|') {
+        if (PeekChar(scanner) == '|') {
             scanner->pSrc++;
             operandFlags |= DxbcOperandFlag_SrcAbs;
         }
 
         ByteView argstr;
-        result = ScanCName(scanner, &argstr);
-        if (result != DxbcTextScanResult::Okay) {
-            fprintf(stderr, "bad arg string[%d], err=%d\n", argIndex, int(result));
-        }
+        SCAN_TRY(ScanCName(scanner, &argstr), "expected operand");
 
         int immSrcComponents = -1;
         int slot = -1;
@@ -383,33 +1456,26 @@ DxbcText_ScanInstrInFuncBody(DxbcTextScanner *scanner, DxbcInstruction *instr)
         uint operandFirstChar = *argstr.pbegin++;
         if (operandFirstChar == 'l') {
             file = DxbcFile::immediate;
-            Verify(argIndex >= numDests, "imm can't be dst");
-            operandFirstChar = ScanChar(scanner);
-            Verify(operandFirstChar == '(', "should have paren at start of immediate vec<{float, int}, {1, 2, 3, 4}>");
+            SCAN_VERIFY_AT(argIndex >= numDests, argstr.pbegin - 1, BadOperand, "immediate can't be a destination");
+            SCAN_VERIFY(ScanChar(scanner) == '(', BadSyntax, "should have paren at start of immediate vec<{float, int}, {1, 2, 3, 4}>");
+            slot = int(immediates->size());
+            DxbcImmediate *const imm = immediates->uninitialized_push();
+            // debug:
+            for (uint c = 0; c < 4; ++c) {
+                imm->u[c] = 0xdead0000u | c;
+            }
             int comp = 0;
             for (;; ++comp) {
-                Verify(comp < 4u, "imm vec too many comps");
-                bool hasDot = false;
-                for (const char *p = scanner->pSrc;;) {
-                    if (*p == '.') {
-                        hasDot = true;
-                        break;
-                    }
-                    else if (*p - '0' >= 10u) {
-                        break;
-                    }
-                    ++p;
-                }
+                SkipWs(scanner);
+                SCAN_VERIFY(uint(comp) < 4u, BadOperand, "immediate has more than 4 components");
+                const char *pDigits = scanner->pSrc + (PeekChar(scanner) == '-');
+                const char *pAfterDigits = SkipCharClass<CharClass::digit>(pDigits, scanner->pEnd);
+                bool const hasDot = pAfterDigits != scanner->pEnd && *pAfterDigits == '.';
                 if (hasDot) {
-                    float fval = strtof(scanner->pSrc, const_cast<char **>(&scanner->pSrc));
-                    Verify(errno == 0, "bad float immediate");
-                    instr->operands[argIndex].immediateValue.f[comp] = fval;
+                    SCAN_TRY(ScanFloat(scanner, &imm->f[comp]), "bad float immediate");
                 }
                 else {
-                    long long ival = strtoll(scanner->pSrc, const_cast<char **>(&scanner->pSrc), 0);
-                    Verify(errno == 0, "bad int immediate");
-                    Verify(ival >= INT32_MIN && ival <= INT32_MAX, "int immediate out of range");
-                    instr->operands[argIndex].immediateValue.u[comp] = int32_t(ival);
+                    SCAN_TRY(ScanInt32Bits(scanner, &imm->u[comp]), "bad integer immediate");
                 }
                 operandFirstChar = ScanChar(scanner);
                 if (operandFirstChar == ',') {
@@ -419,24 +1485,23 @@ DxbcText_ScanInstrInFuncBody(DxbcTextScanner *scanner, DxbcInstruction *instr)
                     break;
                 }
                 else {
-                    Verify(0, "validation code is not fun to write at the moment");
+                    return ScanError(scanner, scanner->pSrc - (operandFirstChar != 0), DxbcTextScanResult::BadSyntax, "expected ',' or ')' in immediate");
                 }
             }
             immSrcComponents = comp + 1;
         }
         else if (operandFirstChar == 'v') {
+            SCAN_VERIFY_AT(argIndex >= numDests, argstr.pbegin - 1, BadOperand, "input can't be a destination");
             if (EqualStrZ(argstr, "ThreadID")) {
-                Verify(argIndex >= numDests, "vThreadID can't be dst");
                 file = DxbcFile::vThreadID;
                 slot = 0;
             }
             else if (EqualStrZ(argstr, "ThreadIDInGroupFlattened")) {
-                Verify(argIndex >= numDests, "v* can't be dst");
                 file = DxbcFile::vThreadIDInGroupFlattened;
                 slot = 0;
             }
             else {
-                Verify(0, "TODO: implement v* input besides vThreadID");
+                return ScanError(scanner, argstr.pbegin - 1, DxbcTextScanResult::Unsupported, "TODO: implement v* input besides vThreadID");
             }
         }
         else {
@@ -444,25 +1509,23 @@ DxbcText_ScanInstrInFuncBody(DxbcTextScanner *scanner, DxbcInstruction *instr)
             case 'u':
             case 'r': {
                 file = operandFirstChar == 'u' ? DxbcFile::uav : DxbcFile::temp;
-                slot = 0;
+                uint reg = 0;
                 const char *p = argstr.pbegin;
-                VERIFY(*p - '0' < 10u);
-                for (;;) {
-                    uint d = *p - '0';
+                SCAN_VERIFY_AT(p != argstr.pend && IsDecimalDigit(ubyte(*p)), argstr.pbegin - 1, BadOperand, "expected register number");
+                for (; p != argstr.pend;) {
+                    uint d = ubyte(*p) - '0';
                     if (d >= 10u) {
                         break;
                     }
                     p++;
-                    slot = slot*10u + d;
-                    VERIFY(slot < 4096u);
+                    reg = reg*10u + d;
+                    SCAN_VERIFY_AT(reg < 4096u, argstr.pbegin - 1, BadOperand, "register number should be below 4096");
                 }
+                slot = int(reg);
                 scanner->pSrc = p;
             } break;
             default: {
-                // could be EOF here
-                fprintf(stderr, "bad arg[%d] first char: %c", argIndex, argstr.pbegin[0]);
-                ASSERT(0);
-                return DxbcTextScanResult::Other;
+                return ScanError(scanner, argstr.pbegin - 1, DxbcTextScanResult::BadOperand, "unknown register file");
             } break;
             }
         }
@@ -471,37 +1534,34 @@ DxbcText_ScanInstrInFuncBody(DxbcTextScanner *scanner, DxbcInstruction *instr)
         instr->operands[argIndex].slotInFile = slot;
 
         ByteView maskStr;
+        uint swizzle; // lined up
         if (file != DxbcFile::immediate) {
-            char const shouldBeDot = ScanChar(scanner);
-            Verify(shouldBeDot == '.', "should have dot before writemask/sizzle");
-            DxbcTextScanResult maskRes = ScanCName(scanner, &maskStr);
-            VERIFY(maskRes == DxbcTextScanResult::Okay);
-            VERIFY(maskStr.Length() - 1u < 4u);
+            SCAN_VERIFY(ScanChar(scanner) == '.', BadSyntax, "should have dot before writemask/swizzle");
+            SCAN_TRY(ScanCName(scanner, &maskStr), "expected writemask/swizzle");
+            SCAN_VERIFY_AT(maskStr.Length() - 1u < 4u, maskStr.pbegin, BadOperand, "writemask/swizzle should be 1 to 4 components");
+            SCAN_VERIFY_AT(DecodeCompString(maskStr, scanner->pEnd, &swizzle), maskStr.pbegin, BadOperand, "writemask/swizzle should only have x, y, z, w");
         }
         else {
             static const char az_xyz[] = "xyzw";
             maskStr = { az_xyz, az_xyz + immSrcComponents };
+            swizzle = DxbcSourceSwizzle(0, 1, 2, 3).bits & ((1u << immSrcComponents * 2) - 1u); // "xyzw" cut short
         }
+        // where to point at for bad masks/swizzles, maskStr of immediates isn't in the text:
+        const char *const pMaskAt = file != DxbcFile::immediate ? maskStr.pbegin : argstr.pbegin - 1;
 
         if (argIndex < numDests) {
             // parse dst writemask and saturate
-            uint writeMask = 0;
-            for (char ch : maskStr) {
-                uint comp = LetterToCompIndex(ch);
-                VERIFY(comp < 4u);
-                Verify(!(writeMask & 1u << comp), "bad writemask");
-                writeMask |= 1u << comp;
-            }
-            instr->operands[argIndex].dstWritemask = writeMask;
+            uint const writeMask = WriteMaskOfCompString(swizzle, maskStr.Length());
+            SCAN_VERIFY_AT(writeMask, pMaskAt, BadOperand, "bad writemask");
+            instr->operands[argIndex].dstWritemask = uint8_t(writeMask);
             writeMaskCharLen = maskStr.Length();
             writeMaskBits = writeMask;
-            VERIFY((operandFlags & ~DxbcOperandFlag_DstSat) == 0);
+            SCAN_VERIFY_AT((operandFlags & ~DxbcOperandFlag_DstSat) == 0, argstr.pbegin - 1, BadOperand, "destination can't have -/|abs|");
         }
         else {
             // parse src swizzle and abs/neg
             if (numDests) {
-                VERIFY(maskStr.Length());
-                VERIFY(srcSwizzleCharLen < 0 || srcSwizzleCharLen == maskStr.Length());
+                SCAN_VERIFY_AT(srcSwizzleCharLen < 0 || srcSwizzleCharLen == int(maskStr.Length()), pMaskAt, BadOperand, "sources have swizzles of different lengths");
                 srcSwizzleCharLen = maskStr.Length();
             }
 
@@ -516,40 +1576,28 @@ DxbcText_ScanInstrInFuncBody(DxbcTextScanner *scanner, DxbcInstruction *instr)
                 when the string-length of the writemask is the same as the string-length of the swizzles.
             */
             bool const bModeGLSL = (writeMaskCharLen == srcSwizzleCharLen) && numDests;
-            uint swizzle = 0;
             if (bModeGLSL) {
-                uint tmpWriteMask = writeMaskBits;
                 // 5 (0101), 9 (1001), 10 (1010) are not contiguous:
                 // ................................fedcba9876543210
-                VERIFY(writeMaskBits < 0x10u && (0b1111100111011110u & 1u << writeMaskBits));
-                const char *str = maskStr.pbegin;
-                do {
-                    uint const writeCompIndex = bsf(tmpWriteMask);
-                    tmpWriteMask ^= 1u << writeCompIndex; // clear bit since it was 1
-                    uint const srcCompIndex = LetterToCompIndex(*str++);
-                    VERIFY(srcCompIndex < 4u);
-                    swizzle |= srcCompIndex << (writeCompIndex * 2);
-                } while (tmpWriteMask);
+                SCAN_VERIFY_AT(writeMaskBits < 0x10u && (0b1111100111011110u & 1u << writeMaskBits), pMaskAt, Unsupported, "non-contiguous writemask with a short swizzle");
+                // char i goes to the i-th written component:
+                uint packed = swizzle;
+                swizzle = 0;
+                for (uint wm = writeMaskBits; wm; wm &= wm - 1) {
+                    swizzle |= (packed & 3u) << (bsf(wm) * 2);
+                    packed >>= 2;
+                }
             } else {
                 // example: and r0.yz, vThreadID.xxxx, l(0, 4, 2, 0)
                 // if_nz r0.y
-                uint i = 0;
-                VERIFY(numDests == 0 || maskStr.Length() == 4); // hmm, think this should be the case.
-                for (char ch : maskStr) {
-                    uint comp = LetterToCompIndex(ch);
-                    VERIFY(comp < 4u);
-                    swizzle |= comp << (i++ * 2);
-                }
+                // hmm, think this should be the case:
+                SCAN_VERIFY_AT(numDests == 0 || maskStr.Length() == 4, pMaskAt, BadOperand, "swizzle length should match writemask or be 4");
             }
-            instr->operands[argIndex].srcSwizzle.bits = swizzle;
+            instr->operands[argIndex].srcSwizzle.bits = uint8_t(swizzle);
             if (operandFlags & DxbcOperandFlag_SrcAbs) {
                 // closing absolute-value bar: "add r0.y, -|r0.z|, r0.y"
-                if (scanner->pSrc[0] == '|') {
-                    scanner->pSrc++;
-                }
-                else {
-                    VERIFY(0);
-                }
+                SCAN_VERIFY(PeekChar(scanner) == '|', BadSyntax, "expected closing '|'");
+                scanner->pSrc++;
             }
         }
         instr->operands[argIndex].flags = operandFlags;
@@ -557,19 +1605,363 @@ DxbcText_ScanInstrInFuncBody(DxbcTextScanner *scanner, DxbcInstruction *instr)
         if (++argIndex == numTotalOperands) {
             break;
         }
-        char const shouldBeComma = ScanChar(scanner);
-        Verify(shouldBeComma == ',', "should have comma after operand");
+        SCAN_VERIFY(ScanChar(scanner) == ',', BadSyntax, "should have comma after operand");
     }
 
     return DxbcTextScanResult::Okay;
 }
 
 
+void
+DxbcText_Init(DxbcTextScanner *scanner, const char *pText, const char *pTextEnd)
+{
+    *scanner = {};
+    scanner->pSrc = pText;
+    scanner->pEnd = pTextEnd;
+    scanner->pBegin = pText;
+}
+
+DxbcTextLocation
+DxbcText_GetErrorLocation(const DxbcTextScanner *scanner)
+{
+    ASSERT(scanner->errorMessage);
+    return LocationOf(scanner->pBegin, scanner->pErrorAt);
+}
+
 bool
 DxbcText_ScanIsEof(DxbcTextScanner *scanner)
 {
-    scanner->pSrc = SkipWs(scanner->pSrc);
-    return scanner->pSrc[0] == 0;
+    SkipWs(scanner);
+    return scanner->pSrc == scanner->pEnd;
+}
+
+const char *
+DxbcControlFlow_Check(DxbcControlFlowCheck *check, const DxbcInstruction& instr)
+{
+    Array<DxbcInstrTag>& open = check->open;
+    DxbcInstrTag *const pInnermost = open.is_empty() ? nullptr : open.end() - 1;
+    switch (instr.tag) {
+    case DxbcInstrTag::if_:
+        open.push(instr.tag);
+        break;
+    case DxbcInstrTag::_else:
+        if (!pInnermost || *pInnermost != DxbcInstrTag::if_) {
+            return "else without an if";
+        }
+        *pInnermost = DxbcInstrTag::_else;
+        break;
+    case DxbcInstrTag::endif:
+        if (!pInnermost || (*pInnermost != DxbcInstrTag::if_ && *pInnermost != DxbcInstrTag::_else)) {
+            return "endif without an if";
+        }
+        open.pop();
+        break;
+    case DxbcInstrTag::loop:
+        open.push(instr.tag);
+        check->numOpenLoops++;
+        break;
+    case DxbcInstrTag::endloop:
+        if (!pInnermost || *pInnermost != DxbcInstrTag::loop) {
+            return "endloop without a loop";
+        }
+        open.pop();
+        check->numOpenLoops--;
+        break;
+    case DxbcInstrTag::break_:
+    case DxbcInstrTag::breakc:
+    case DxbcInstrTag::continue_:
+    case DxbcInstrTag::continuec:
+        if (!check->numOpenLoops) {
+            return "break or continue outside of a loop";
+        }
+        break;
+    default:
+        break;
+    }
+    return nullptr;
+}
+
+const char *
+DxbcControlFlow_CheckEnd(const DxbcControlFlowCheck *check)
+{
+    if (check->open.is_empty()) {
+        return nullptr;
+    }
+    return check->open.end()[-1] == DxbcInstrTag::loop ? "missing endloop" : "missing endif";
+}
+
+/*
+    The rest of the text, instructions that scanned fine stay in instrs on an error. With a
+    controlFlow the nesting is checked too, which needs the whole body, not a piece of it.
+*/
+static DxbcTextScanResult
+ScanBody(DxbcTextScanner *scanner, Array<DxbcInstruction> *instrs, Array<DxbcImmediate> *immediates,
+         DxbcControlFlowCheck *controlFlow)
+{
+    // listings are ~30 chars per instruction, don't grow a few times for small shaders:
+    instrs->reserve(instrs->size() + uint(Max<ptrdiff_t>(scanner->pEnd - scanner->pSrc, 512) / 32));
+    while (!DxbcText_ScanIsEof(scanner)) {
+        const char *const pInstrText = scanner->pSrc;
+        DxbcInstruction *instr = instrs->uninitialized_push();
+        DxbcTextScanResult const result = DxbcText_ScanInstrInFuncBody(scanner, instr, immediates);
+        if (result != DxbcTextScanResult::Okay) {
+            instrs->pop();
+            return result;
+        }
+        if (controlFlow) {
+            const char *const message = DxbcControlFlow_Check(controlFlow, *instr);
+            SCAN_VERIFY_AT(!message, pInstrText, BadNesting, message);
+        }
+    }
+    if (controlFlow) {
+        const char *const message = DxbcControlFlow_CheckEnd(controlFlow);
+        SCAN_VERIFY(!message, BadNesting, message);
+    }
+    return DxbcTextScanResult::Okay;
+}
+
+DxbcTextScanResult
+DxbcText_Decode(DxbcTextScanner *scanner, DxbcShader *shader)
+{
+    DxbcTextScanResult const result = DxbcText_ScanHeader(scanner, &shader->header);
+    if (result != DxbcTextScanResult::Okay) {
+        return result;
+    }
+    DxbcControlFlowCheck controlFlow;
+    return ScanBody(scanner, &shader->instrs, &shader->immediates, &controlFlow);
+}
+
+/*
+    Parallel body scan: after the header every instruction is on its own line, so the body can be cut at
+    newlines and the pieces scanned independently. Each piece gets its own instructions and immediates,
+    which are concatenated in order afterwards, rebasing the immediate slots.
+*/
+struct DxbcTextBodyPiece {
+    DxbcTextScanner scanner;
+    DxbcTextScanResult result;
+    Array<DxbcInstruction> instrs;
+    Array<DxbcImmediate> immediates;
+};
+
+static void
+ScanBodyPiece(DxbcTextBodyPiece *piece)
+{
+    piece->result = ScanBody(&piece->scanner, &piece->instrs, &piece->immediates, nullptr);
+}
+
+DxbcTextScanResult
+DxbcText_DecodeParallel(DxbcTextScanner *scanner, DxbcShader *shader, uint numThreads)
+{
+    // below this, starting threads costs more than the scan:
+    static const ptrdiff_t MinBytesPerPiece = 256 * 1024;
+
+    DxbcTextScanResult result = DxbcText_ScanHeader(scanner, &shader->header);
+    if (result != DxbcTextScanResult::Okay) {
+        return result;
+    }
+    if (!numThreads) {
+        numThreads = Max(1u, std::thread::hardware_concurrency());
+    }
+    ptrdiff_t const numBodyBytes = scanner->pEnd - scanner->pSrc;
+    uint const numPieces = uint(Max<ptrdiff_t>(1, Min<ptrdiff_t>(numThreads, numBodyBytes / MinBytesPerPiece)));
+    if (numPieces == 1) {
+        DxbcControlFlowCheck controlFlow;
+        return ScanBody(scanner, &shader->instrs, &shader->immediates, &controlFlow);
+    }
+    DxbcTextScanner const bodyScanner = *scanner;
+
+    std::vector<DxbcTextBodyPiece> pieces(numPieces);
+    const char *pPieceBegin = scanner->pSrc;
+    for (uint i = 0; i < numPieces; ++i) {
+        // cut after the first newline past the even split, the last piece takes the rest:
+        const char *pPieceEnd = scanner->pEnd;
+        if (i + 1 < numPieces) {
+            const char *const pSplit = Max(pPieceBegin, scanner->pSrc + numBodyBytes / numPieces * (i + 1));
+            pPieceEnd = SkipRestOfLine(pSplit, scanner->pEnd);
+        }
+        pieces[i].scanner = *scanner; // pBegin stays at the start of the text for error locations
+        pieces[i].scanner.pSrc = pPieceBegin;
+        pieces[i].scanner.pEnd = pPieceEnd;
+        pPieceBegin = pPieceEnd;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(numPieces - 1);
+    for (uint i = 1; i < numPieces; ++i) {
+        threads.emplace_back(ScanBodyPiece, &pieces[i]);
+    }
+    ScanBodyPiece(&pieces[0]);
+    for (std::thread& t : threads) {
+        t.join();
+    }
+
+    // Concatenate up to and including the first piece with an error, same output as DxbcText_Decode:
+    uint numInstrs = 0;
+    uint numUsedPieces = 0;
+    while (numUsedPieces < numPieces) {
+        numInstrs += pieces[numUsedPieces].instrs.size();
+        result = pieces[numUsedPieces++].result;
+        if (result != DxbcTextScanResult::Okay) {
+            break;
+        }
+    }
+    shader->instrs.reserve(numInstrs);
+    for (uint i = 0; i < numUsedPieces; ++i) {
+        DxbcTextBodyPiece& piece = pieces[i];
+        uint const immediateBase = shader->immediates.size();
+        if (piece.instrs.is_empty()) {
+            continue;
+        }
+        DxbcInstruction *const pDst = shader->instrs.uninitialized_push_n(piece.instrs.size());
+        memcpy(pDst, piece.instrs.data(), piece.instrs.size() * sizeof(DxbcInstruction));
+        if (!piece.immediates.is_empty()) {
+            shader->immediates.push_n(piece.immediates.data(), piece.immediates.size());
+            for (DxbcInstruction *pInstr = pDst; pInstr != shader->instrs.end(); ++pInstr) {
+                for (uint k = 0; k < pInstr->numOperands; ++k) {
+                    if (pInstr->operands[k].file == DxbcFile::immediate) {
+                        pInstr->operands[k].slotInFile += int32_t(immediateBase);
+                    }
+                }
+            }
+        }
+    }
+    *scanner = pieces[numUsedPieces - 1].scanner;
+
+    /*
+        The pieces can't check the nesting, it's checked on the whole body here. Also when a piece
+        failed, over the instructions before its error, a nesting error earlier in the text is the
+        one the serial scan reports. Whether something is left open only when the whole body scanned.
+    */
+    DxbcControlFlowCheck controlFlow;
+    bool nestingOkay = true;
+    for (const DxbcInstruction& instr : shader->instrs) {
+        if (DxbcControlFlow_Check(&controlFlow, instr)) {
+            nestingOkay = false;
+            break;
+        }
+    }
+    if (!nestingOkay || (result == DxbcTextScanResult::Okay && DxbcControlFlow_CheckEnd(&controlFlow))) {
+        // only for broken shaders, scan the body again on this thread for where it went wrong:
+        *scanner = bodyScanner;
+        shader->instrs.set_end(0);
+        shader->immediates.set_end(0);
+        DxbcControlFlowCheck sequentialControlFlow;
+        result = ScanBody(scanner, &shader->instrs, &shader->immediates, &sequentialControlFlow);
+    }
+    return result;
+}
+
+void
+DxbcText_StreamInit(DxbcTextStream *stream)
+{
+    DxbcText_Init(&stream->scanner, nullptr, nullptr);
+    stream->phase = DxbcTextStreamPhase::ShaderModel;
+    stream->numLinesDone = 0;
+    stream->header = { };
+    stream->immediates.set_end(0);
+    stream->partialLine.set_end(0);
+    stream->controlFlow.open.set_end(0);
+    stream->controlFlow.numOpenLoops = 0;
+}
+
+// [pLines, pLinesEnd) are whole lines, carries on with whatever the stream was scanning:
+static DxbcTextScanResult
+StreamScanLines(DxbcTextStream *stream, const char *pLines, const char *pLinesEnd, Array<DxbcInstruction> *instrs)
+{
+    DxbcTextScanner *const scanner = &stream->scanner;
+    DxbcText_Init(scanner, pLines, pLinesEnd);
+
+    DxbcTextScanResult result = DxbcTextScanResult::Okay;
+    while (result == DxbcTextScanResult::Okay && !DxbcText_ScanIsEof(scanner)) {
+        switch (stream->phase) {
+            case DxbcTextStreamPhase::ShaderModel: {
+                result = ScanShaderModel(scanner);
+                stream->phase = DxbcTextStreamPhase::Declarations;
+            } break;
+            case DxbcTextStreamPhase::Declarations: {
+                bool endOfHeader;
+                result = ScanDeclaration(scanner, &stream->header, &endOfHeader);
+                if (endOfHeader) {
+                    stream->phase = DxbcTextStreamPhase::Body;
+                }
+            } break;
+            case DxbcTextStreamPhase::Body: {
+                const char *const pInstrText = scanner->pSrc;
+                DxbcInstruction *instr = instrs->uninitialized_push();
+                result = DxbcText_ScanInstrInFuncBody(scanner, instr, &stream->immediates);
+                if (result != DxbcTextScanResult::Okay) {
+                    instrs->pop();
+                }
+                else if (const char *const message = DxbcControlFlow_Check(&stream->controlFlow, *instr)) {
+                    result = ScanError(scanner, pInstrText, DxbcTextScanResult::BadNesting, message);
+                }
+            } break;
+        }
+    }
+    if (result == DxbcTextScanResult::Okay) {
+        // the text is gone after this, so lines are counted now for the location of a later error:
+        stream->numLinesDone += CountNewlines(pLines, pLinesEnd);
+    }
+    return result;
+}
+
+DxbcTextScanResult
+DxbcText_StreamFeed(DxbcTextStream *stream, const char *pChunk, const char *pChunkEnd, Array<DxbcInstruction> *instrs)
+{
+    // finish the line left over from the last chunk first:
+    if (!stream->partialLine.is_empty()) {
+        const char *const pNewline = static_cast<const char *>(memchr(pChunk, '\n', pChunkEnd - pChunk));
+        const char *const pRest = pNewline ? pNewline + 1 : pChunkEnd;
+        stream->partialLine.push_n(pChunk, uint(pRest - pChunk));
+        if (!pNewline) {
+            return DxbcTextScanResult::Okay;
+        }
+        DxbcTextScanResult const result = StreamScanLines(stream, stream->partialLine.begin(), stream->partialLine.end(), instrs);
+        if (result != DxbcTextScanResult::Okay) {
+            return result; // leave the line around for the error location
+        }
+        stream->partialLine.set_end(0);
+        pChunk = pRest;
+    }
+
+    // lines are short, walking back to the last newline is cheap:
+    const char *pLinesEnd = pChunkEnd;
+    while (pLinesEnd != pChunk && pLinesEnd[-1] != '\n') {
+        --pLinesEnd;
+    }
+    DxbcTextScanResult const result = StreamScanLines(stream, pChunk, pLinesEnd, instrs);
+    if (result != DxbcTextScanResult::Okay) {
+        return result;
+    }
+    if (pLinesEnd != pChunkEnd) {
+        stream->partialLine.push_n(pLinesEnd, uint(pChunkEnd - pLinesEnd));
+    }
+    return DxbcTextScanResult::Okay;
+}
+
+DxbcTextScanResult
+DxbcText_StreamFinish(DxbcTextStream *stream, Array<DxbcInstruction> *instrs)
+{
+    DxbcTextScanResult result = StreamScanLines(stream, stream->partialLine.begin(), stream->partialLine.end(), instrs);
+    if (result == DxbcTextScanResult::Okay && stream->phase == DxbcTextStreamPhase::ShaderModel) {
+        // empty listing, fail like DxbcText_ScanHeader does:
+        result = ScanShaderModel(&stream->scanner);
+    }
+    if (result == DxbcTextScanResult::Okay && stream->phase == DxbcTextStreamPhase::Body) {
+        if (const char *const message = DxbcControlFlow_CheckEnd(&stream->controlFlow)) {
+            result = ScanError(&stream->scanner, stream->scanner.pSrc, DxbcTextScanResult::BadNesting, message);
+        }
+    }
+    return result;
+}
+
+DxbcTextLocation
+DxbcText_StreamGetErrorLocation(const DxbcTextStream *stream)
+{
+    // scanned text always starts at the beginning of a line:
+    DxbcTextLocation loc = DxbcText_GetErrorLocation(&stream->scanner);
+    loc.line += stream->numLinesDone;
+    return loc;
 }
 
 #if 0 // likely not interesting anymore
@@ -597,7 +1989,7 @@ ret
 
     DxbcHeaderInfo header;
     result = DxbcText_ScanHeader(&scanner, &header);
-    VERIFY(result == DxbcTextScanResult::Okay);
+    ASSERT(result == DxbcTextScanResult::Okay);
 
 
     DxbcInstruction instr;
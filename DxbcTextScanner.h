@@ -2,18 +2,121 @@
 
 #include <stdint.h>
 
+#include "Array.h"
+
+// In the order of the flag bits of the binary dcl_globalFlags, which start at bit 11:
+enum {
+    DXBC_GLOBAL_FLAG_REFACTORING_ALLOWED = 1u << 0,
+    DXBC_GLOBAL_FLAG_ENABLE_DOUBLE_PRECISION_FLOAT_OPS = 1u << 1,
+    DXBC_GLOBAL_FLAG_FORCE_EARLY_DEPTH_STENCIL = 1u << 2,
+    DXBC_GLOBAL_FLAG_ENABLE_RAW_AND_STRUCTURED_BUFFERS = 1u << 3,
+    DXBC_GLOBAL_FLAG_SKIP_OPTIMIZATION = 1u << 4,
+    DXBC_GLOBAL_FLAG_ENABLE_MINIMUM_PRECISION = 1u << 5,
+    DXBC_GLOBAL_FLAG_ENABLE_11_1_DOUBLE_EXTENSIONS = 1u << 6,
+    DXBC_GLOBAL_FLAG_ENABLE_11_1_SHADER_EXTENSIONS = 1u << 7,
+};
+
+// cs_5_0 register counts, the decl arrays in DxbcHeaderInfo are indexed by register:
 enum {
-    DXBC_GLOBAL_FLAG_REFACTORING_ALLOWED = 1u << 0
+    DXBC_MAX_RESOURCES = 128, // t#
+    DXBC_MAX_UAVS = 64, // u#
+    DXBC_MAX_SAMPLERS = 16, // s#
+    DXBC_MAX_CONSTANT_BUFFERS = 14, // cb#
+    DXBC_MAX_TGSMS = 32, // g#
+    DXBC_MAX_INDEXABLE_TEMPS = 32, // x#
+};
+
+// Same order as the binary encoding:
+enum class DxbcResourceDim : uint8_t {
+    unknown,
+    buffer,
+    texture1d,
+    texture2d,
+    texture2dms,
+    texture3d,
+    texturecube,
+    texture1darray,
+    texture2darray,
+    texture2dmsarray,
+    texturecubearray,
+    raw,
+    structured,
+};
+
+// (float,float,float,float) of typed resources and uavs, same order as the binary encoding:
+enum class DxbcReturnType : uint8_t {
+    none,
+    unorm,
+    snorm,
+    sint,
+    uint,
+    float_,
+    mixed,
+    double_,
+    continued,
+};
+
+enum {
+    DxbcResourceFlag_GloballyCoherent = 1 << 0, // dcl_uav_*_glc
+    DxbcResourceFlag_OrderPreservingCounter = 1 << 1, // dcl_uav_structured_opc
+};
+
+// dcl_resource_* t# and dcl_uav_* u#:
+struct DxbcResourceDecl {
+    DxbcResourceDim dim;
+    uint8_t flags;
+    uint8_t sampleCount; // texture2dms(n)
+    DxbcReturnType returnTypes[4]; // typed only
+    uint32_t stride; // structured only, in bytes
+};
+
+enum class DxbcSamplerMode : uint8_t {
+    default_,
+    comparison,
+    mono,
+};
+
+// dcl_constantbuffer cb0[4], immediateIndexed
+struct DxbcConstantBufferDecl {
+    uint16_t numVec4s;
+    bool dynamicIndexed;
+};
+
+// dcl_tgsm_raw g0, 1024 or dcl_tgsm_structured g0, 4, 256
+struct DxbcTgsmDecl {
+    uint32_t stride; // 0 for raw
+    uint32_t numBytes;
+};
+
+// dcl_indexableTemp x0[16], 4
+struct DxbcIndexableTempDecl {
+    uint32_t numRegs;
+    uint8_t numComponents;
 };
 
 struct DxbcHeaderInfo {
-    uint8_t globalFlags; // dcl_globalFlags refactoringAllowed
+    uint8_t globalFlags; // DXBC_GLOBAL_FLAG_*, dcl_globalFlags refactoringAllowed | skipOptimization
     uint8_t vThreadID_usedMask;
+    uint8_t vThreadGroupID_usedMask;
+    uint8_t vThreadIDInGroup_usedMask;
     bool vThreadIDInGroupFlattened;
     uint16_t numTemps; // up to 4096 32bitx4 temps, r0 through rN-1
     struct { int x, y, z; } workgroupSize;
 
-    enum : uint64_t { uavDeclMask = 1 }; // TODO
+    // bit i set if register i is declared:
+    uint64_t resourceDeclMask[DXBC_MAX_RESOURCES / 64];
+    uint64_t uavDeclMask;
+    uint16_t samplerDeclMask;
+    uint16_t constantBufferDeclMask;
+    uint32_t tgsmDeclMask;
+    uint32_t indexableTempDeclMask;
+
+    DxbcResourceDecl resources[DXBC_MAX_RESOURCES];
+    DxbcResourceDecl uavs[DXBC_MAX_UAVS];
+    DxbcSamplerMode samplerModes[DXBC_MAX_SAMPLERS];
+    DxbcConstantBufferDecl constantBuffers[DXBC_MAX_CONSTANT_BUFFERS];
+    DxbcTgsmDecl tgsms[DXBC_MAX_TGSMS];
+    DxbcIndexableTempDecl indexableTemps[DXBC_MAX_INDEXABLE_TEMPS];
 };
 
 struct DxbcSourceSwizzle {
@@ -46,31 +149,64 @@ enum class DxbcInstrClass : uint8_t {
     dst0_assign_tri_op,
 };
 
+/*
+    Every instruction in the function body, the one place to add one. Expanded into DxbcInstrTag,
+    the mnemonic table of the text scanner, the opcode table of the binary scanner, and the
+    SPIR-V op and lowering tables of Codegen, so those can't get out of sync:
+
+        X(tag, mnemonic, DxbcInstrClass, D3D10_SB_OPCODE_TYPE (SbOp_*), similar SpvOp, SpirvOpClass, Codegen handler (Lower*))
+
+    Ops without a similar SPIR-V op have Nop and misc. if_z and a plain "if" are handled by the
+    text scanner before the mnemonic lookup, breakc_z and continuec_z are other spellings in its table.
+*/
+#define DXBC_INSTRUCTIONS(X) \
+    X(ret,             "ret",             misc_in_function_body, Ret,           Nop,               misc,           Ret) \
+    X(if_,             "if_nz",           misc_in_function_body, If,            Nop,               misc,           If) \
+    X(_else,           "else",            misc_in_function_body, Else,          Nop,               misc,           Else) \
+    X(endif,           "endif",           misc_in_function_body, EndIf,         Nop,               misc,           EndIf) \
+    X(loop,            "loop",            misc_in_function_body, Loop,          Nop,               misc,           Loop) \
+    X(endloop,         "endloop",         misc_in_function_body, EndLoop,       Nop,               misc,           EndLoop) \
+    X(break_,          "break",           misc_in_function_body, Break,         Nop,               misc,           Break) \
+    X(breakc,          "breakc_nz",       misc_in_function_body, BreakC,        Nop,               misc,           BreakC) \
+    X(continue_,       "continue",        misc_in_function_body, Continue,      Nop,               misc,           Continue) \
+    X(continuec,       "continuec_nz",    misc_in_function_body, ContinueC,     Nop,               misc,           ContinueC) \
+    X(ld_uav_typed,    "ld_uav_typed",    misc_in_function_body, LdUavTyped,    Nop,               misc,           LdUavTyped) \
+    X(mov,             "mov",             dst0_assign_unary_op,  Mov,           Nop,               misc,           Mov) \
+    X(inot,            "not",             dst0_assign_unary_op,  Not,           Not,               int_common,     AluOp) \
+    X(iand,            "and",             dst0_assign_binary_op, And,           BitwiseAnd,        int_common,     AluOp) \
+    X(ixor,            "xor",             dst0_assign_binary_op, Xor,           BitwiseXor,        int_common,     AluOp) \
+    X(ior,             "or",              dst0_assign_binary_op, Or,            BitwiseOr,         int_common,     AluOp) \
+    X(ishl,            "ishl",            dst0_assign_binary_op, IShl,          ShiftLeftLogical,  int_common,     AluOp) \
+    X(iadd,            "iadd",            dst0_assign_binary_op, IAdd,          IAdd,              int_common,     AluOp) \
+    X(add,             "add",             dst0_assign_binary_op, Add,           FAdd,              float_common,   AluOp) \
+    X(store_uav_typed, "store_uav_typed", dst0_assign_binary_op, StoreUavTyped, Nop,               misc,           StoreUavTyped) \
+    X(ult,             "ult",             dst0_assign_binary_op, ULt,           ULessThan,         int_cmp,        AluOp) \
+    X(uge,             "uge",             dst0_assign_binary_op, UGe,           UGreaterThanEqual, int_cmp,        AluOp) \
+    X(ieq,             "ieq",             dst0_assign_binary_op, IEq,           IEqual,            int_cmp,        AluOp) \
+    X(movc,            "movc",            dst0_assign_tri_op,    MovC,          Select,            select_generic, Movc) \
+    X(imad,            "imad",            dst0_assign_tri_op,    IMad,          Nop,               misc,           Imad)
+
 enum class DxbcInstrTag : uint8_t {
+#define DXBC_INSTR_TAG(tag, mnemonic, cls, sbOp, spvOp, spvOpClass, lower) tag,
+    DXBC_INSTRUCTIONS(DXBC_INSTR_TAG)
+#undef DXBC_INSTR_TAG
+
+    // declarations, those only end up in DxbcHeaderInfo:
     dcl_globalFlags,
-    dcl_uav_typed_buffer,
     dcl_input,
     dcl_temps,
     dcl_thread_group,
-    ret,
-    ult,
-    uge,
-    ieq,
-    mov,
-    movc,
-    ior,
-    iand,
-    ixor,
-    inot,
-    ishl,
-    iadd,
-    imad,
-    add, // flt
-    store_uav_typed,
-    ld_uav_typed,
-    if_,
-    _else,
-    endif,
+    dcl_constantbuffer,
+    dcl_sampler,
+    dcl_resource, // typed, the dimension is in the declaration
+    dcl_resource_raw,
+    dcl_resource_structured,
+    dcl_uav_typed,
+    dcl_uav_raw,
+    dcl_uav_structured,
+    dcl_tgsm_raw,
+    dcl_tgsm_structured,
+    dcl_indexableTemp,
 };
 
 enum {
@@ -84,11 +220,7 @@ struct DxbcOperand {
     uint8_t flags;
     uint8_t dstWritemask;
     DxbcSourceSwizzle srcSwizzle;
-    int16_t slotInFile;
-    union {
-        uint32_t u[4];
-        float f[4];
-    } immediateValue; // maybe shouldn't be here, the slot could be an index into an array.
+    int32_t slotInFile; // for DxbcFile::immediate, the index into DxbcShader::immediates
 };
 
 enum {
@@ -99,7 +231,8 @@ struct DxbcInstruction {
     DxbcInstrTag tag;
     DxbcInstrClass instrClass;
     uint8_t flags;
-    DxbcOperand operands[4];
+    uint8_t numOperands; // dsts first, then srcs
+    DxbcOperand operands[4]; // immediates are in a side table, so these stay small
 
     uint NumDstRegs() const
     {
@@ -123,31 +256,143 @@ struct DxbcInstruction {
     }
 };
 
+// Whole decoded shaders are kept around, keep this small:
+static_assert(sizeof(DxbcOperand) == 8, "");
+static_assert(sizeof(DxbcInstruction) <= 64, "DxbcInstruction should fit in a cache line");
+
+struct DxbcImmediate {
+    union {
+        uint32_t u[4];
+        float f[4];
+    };
+};
+
+/*
+    A whole decoded shader: the function body is one contiguous instruction stream, so passes
+    that want lookahead can walk it as often as they like, and the same decoded shader can be
+    lowered again (with other options) without scanning again.
+    The values of immediate operands are in the immediates side table, slotInFile is the index.
+*/
+struct DxbcShader {
+    DxbcHeaderInfo header;
+    Array<DxbcInstruction> instrs;
+    Array<DxbcImmediate> immediates;
+};
+
+/*
+    Structured control flow, instruction by instruction as the body is scanned: if/else/endif and
+    loop/endloop have to nest and break/continue have to be in a loop. Both front-ends check
+    with this, so Codegen can take it for granted instead of running off the instructions.
+**/
+struct DxbcControlFlowCheck {
+    Array<DxbcInstrTag> open; // if_, _else or loop of each construct not ended yet, innermost last
+    uint numOpenLoops = 0;
+};
+
+// nullptr if instr is fine where it is, else what's wrong with it:
+const char *
+DxbcControlFlow_Check(DxbcControlFlowCheck *check, const DxbcInstruction& instr);
+
+// At the end of the body, nullptr if nothing is left open:
+const char *
+DxbcControlFlow_CheckEnd(const DxbcControlFlowCheck *check);
+
 enum class DxbcTextScanResult {
     Okay,
     Eof,
     ExpectedAlpha,
     UnknownInstruction,
+    ExpectedNumber,
+    NumberOutOfRange, // or a float that overflows
+    BadSyntax, // missing ',', '.', '(' and so on
+    BadOperand, // bad register, writemask or swizzle
+    BadNesting, // if/else/endif or loop/endloop that don't pair up, break/continue outside of a loop
+    Unsupported, // valid DXBC that isn't handled (yet)
     Other,
 };
 
 struct DxbcTextScanner {
-    const char *pSrc; // must be 0-terminated
+    const char *pSrc;
+    const char *pEnd; // no terminator needed, nothing at or past this is read
+    const char *pBegin; // for line numbers
 
-    // line number
+    // Set when a scan function returns an error (not for Eof at the end of the body):
+    const char *pErrorAt;
+    const char *errorMessage;
 
     // Split up multi-dest macro functions, have state here for those?
     // Then would be less like dxbc.
 };
 
+struct DxbcTextLocation {
+    uint line, column; // 1-based, column counts bytes
+};
+
+void
+DxbcText_Init(DxbcTextScanner *scanner, const char *pText, const char *pTextEnd);
+
+// Only valid after a scan function returned an error, walks the text so it isn't free:
+DxbcTextLocation
+DxbcText_GetErrorLocation(const DxbcTextScanner *scanner);
+
 // Collects info about everything until the first function definition:
 DxbcTextScanResult
 DxbcText_ScanHeader(DxbcTextScanner *scanner, DxbcHeaderInfo *headerInfo);
 
+// Values of immediate operands are appended to immediates:
+DxbcTextScanResult
+DxbcText_ScanInstrInFuncBody(DxbcTextScanner *scanner, DxbcInstruction *instr, Array<DxbcImmediate> *immediates);
+
+// Scans the header and the whole function body in a single pass:
+DxbcTextScanResult
+DxbcText_Decode(DxbcTextScanner *scanner, DxbcShader *shader);
+
+/*
+    Same result as DxbcText_Decode, but a large body is cut at line boundaries and the pieces are scanned
+    on numThreads threads (0 for one per core), small ones are just scanned on this thread.
+    Instructions may not span lines, fxc never does that.
+**/
 DxbcTextScanResult
-DxbcText_ScanInstrInFuncBody(DxbcTextScanner *scanner, DxbcInstruction *instr);
+DxbcText_DecodeParallel(DxbcTextScanner *scanner, DxbcShader *shader, uint numThreads);
 
 // Name this better? may advance in the string:
 bool
 DxbcText_ScanIsEof(DxbcTextScanner *scanner);
 
+/*
+    Resumable scanning of a listing that arrives in chunks (from a pipe, socket, decompressor...).
+    Only whole lines are scanned, the incomplete last line of a chunk is kept until its newline
+    arrives, so memory is bounded by the longest line and the decoded output, not the listing.
+    Declarations and instructions may not span lines, fxc never does that.
+**/
+enum class DxbcTextStreamPhase : uint8_t {
+    ShaderModel,
+    Declarations,
+    Body, // header is complete
+};
+
+struct DxbcTextStream {
+    DxbcTextScanner scanner; // over the lines scanned last, for the error
+    DxbcTextStreamPhase phase;
+    uint numLinesDone; // before the lines scanner is over
+    DxbcHeaderInfo header;
+    Array<DxbcImmediate> immediates; // slotInFile of immediate operands index this
+    Array<char> partialLine;
+    DxbcControlFlowCheck controlFlow;
+};
+
+void
+DxbcText_StreamInit(DxbcTextStream *stream);
+
+// Appends the instructions on the lines completed by this chunk to instrs, the chunk can be reused after:
+DxbcTextScanResult
+DxbcText_StreamFeed(DxbcTextStream *stream, const char *pChunk, const char *pChunkEnd, Array<DxbcInstruction> *instrs);
+
+// At the end of the input, scans the last line if it has no newline:
+DxbcTextScanResult
+DxbcText_StreamFinish(DxbcTextStream *stream, Array<DxbcInstruction> *instrs);
+
+// Only valid after a stream function returned an error, and before the chunk passed to it is reused:
+DxbcTextLocation
+DxbcText_StreamGetErrorLocation(const DxbcTextStream *stream);
+
@@ -0,0 +1,104 @@
+#include "MappedFile.h"
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+bool
+MapFileReadOnly(const char *path, MappedFile *file)
+{
+    *file = {};
+    HANDLE hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(hFile, &size) || uint64_t(size.QuadPart) > SIZE_MAX) {
+        CloseHandle(hFile);
+        return false;
+    }
+    file->hFile = hFile;
+    if (size.QuadPart == 0) {
+        // CreateFileMapping fails for empty files
+        return true;
+    }
+    HANDLE hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void *p = hMapping ? MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!p) {
+        if (hMapping) {
+            CloseHandle(hMapping);
+        }
+        CloseHandle(hFile);
+        *file = {};
+        return false;
+    }
+    file->hMapping = hMapping;
+    file->pBegin = static_cast<const char *>(p);
+    file->pEnd = file->pBegin + size_t(size.QuadPart);
+    return true;
+}
+
+void
+UnmapFile(MappedFile *file)
+{
+    if (file->pBegin) {
+        UnmapViewOfFile(file->pBegin);
+    }
+    if (file->hMapping) {
+        CloseHandle(file->hMapping);
+    }
+    if (file->hFile) {
+        CloseHandle(file->hFile);
+    }
+    *file = {};
+}
+#else
+bool
+MapFileReadOnly(const char *path, MappedFile *file)
+{
+    *file = {};
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    size_t const size = size_t(st.st_size);
+    if (size == 0) {
+        // mmap fails for a length of 0
+        close(fd);
+        return true;
+    }
+    void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps its own reference
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    madvise(p, size, MADV_SEQUENTIAL);
+    file->pBegin = static_cast<const char *>(p);
+    file->pEnd = file->pBegin + size;
+    file->numMappedBytes = size;
+    return true;
+}
+
+void
+UnmapFile(MappedFile *file)
+{
+    if (file->numMappedBytes) {
+        munmap(const_cast<char *>(file->pBegin), file->numMappedBytes);
+    }
+    *file = {};
+}
+#endif
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+    Read-only view of a whole file, so the scanners can run directly over the page cache
+    instead of a copy. An empty file maps fine with pBegin == pEnd.
+*/
+struct MappedFile {
+    const char *pBegin;
+    const char *pEnd;
+#ifdef _WIN32
+    void *hFile;
+    void *hMapping;
+#else
+    size_t numMappedBytes;
+#endif
+};
+
+bool MapFileReadOnly(const char *path, MappedFile *file);
+void UnmapFile(MappedFile *file);
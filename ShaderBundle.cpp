@@ -0,0 +1,106 @@
+#include "ShaderBundle.h"
+
+#include "Array.h"
+
+#include <stdio.h>
+#include <string.h>
+
+bool
+ShaderBundle_Open(const char *path, ShaderBundle *bundle)
+{
+    *bundle = {};
+    if (!MapFileReadOnly(path, &bundle->file)) {
+        return false;
+    }
+
+    uint64_t const fileSize = uint64_t(bundle->file.pEnd - bundle->file.pBegin);
+    ShaderBundleHeader header;
+    if (fileSize < sizeof header) {
+        ShaderBundle_Close(bundle);
+        return false;
+    }
+    memcpy(&header, bundle->file.pBegin, sizeof header);
+    uint64_t const indexEnd = sizeof header + uint64_t(header.numShaders) * sizeof(ShaderBundleEntry);
+    if (memcmp(header.magic, SHADER_BUNDLE_MAGIC, 4) != 0 || header.version != SHADER_BUNDLE_VERSION || indexEnd > fileSize) {
+        ShaderBundle_Close(bundle);
+        return false;
+    }
+
+    // Only the index is checked, so ShaderBundle_ShaderBegin/End can't go out of the mapping:
+    const ShaderBundleEntry *const entries = reinterpret_cast<const ShaderBundleEntry *>(bundle->file.pBegin + sizeof header);
+    for (uint32_t i = 0; i < header.numShaders; ++i) {
+        const ShaderBundleEntry& e = entries[i];
+        if (e.offset < indexEnd || e.offset % 4u || e.offset > fileSize || e.numBytes > fileSize - e.offset) {
+            ShaderBundle_Close(bundle);
+            return false;
+        }
+    }
+    bundle->entries = entries;
+    bundle->numShaders = header.numShaders;
+    return true;
+}
+
+void
+ShaderBundle_Close(ShaderBundle *bundle)
+{
+    UnmapFile(&bundle->file);
+    *bundle = {};
+}
+
+uint64_t
+ShaderBundle_Hash(const char *pBegin, const char *pEnd)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (const char *p = pBegin; p != pEnd; ++p) {
+        h = (h ^ uint8_t(*p)) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+bool
+ShaderBundle_Write(const char *path, const char *const *shaderPaths, uint32_t numShaders)
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        perror(path);
+        return false;
+    }
+
+    // The index is only known after all shaders are written, leave room for it and write it last:
+    Array<ShaderBundleEntry> entries;
+    entries.reserve(numShaders);
+    ShaderBundleHeader header = {};
+    memcpy(header.magic, SHADER_BUNDLE_MAGIC, 4);
+    header.version = SHADER_BUNDLE_VERSION;
+    header.numShaders = numShaders;
+    uint64_t offset = sizeof header + uint64_t(numShaders) * sizeof(ShaderBundleEntry);
+    bool ok = fseek(fp, long(offset), SEEK_SET) == 0;
+
+    for (uint32_t i = 0; ok && i < numShaders; ++i) {
+        MappedFile file;
+        if (!MapFileReadOnly(shaderPaths[i], &file)) {
+            printf("can't open %s\n", shaderPaths[i]);
+            ok = false;
+            break;
+        }
+        size_t const numBytes = size_t(file.pEnd - file.pBegin);
+        entries.push({ offset, numBytes, ShaderBundle_Hash(file.pBegin, file.pEnd) });
+        ok = fwrite(file.pBegin, 1, numBytes, fp) == numBytes;
+        UnmapFile(&file);
+
+        static const char Zeros[4] = {};
+        size_t const numPadBytes = (4u - numBytes % 4u) % 4u;
+        ok = ok && fwrite(Zeros, 1, numPadBytes, fp) == numPadBytes;
+        offset += numBytes + numPadBytes;
+    }
+
+    ok = ok && fseek(fp, 0, SEEK_SET) == 0;
+    ok = ok && fwrite(&header, sizeof header, 1, fp) == 1;
+    ok = ok && (!numShaders || fwrite(entries.data(), sizeof(ShaderBundleEntry), numShaders, fp) == numShaders);
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok) {
+        printf("failed to write %s\n", path);
+        remove(path);
+    }
+    return ok;
+}
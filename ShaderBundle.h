@@ -0,0 +1,61 @@
+#pragma once
+
+#include "MappedFile.h"
+
+#include <stdint.h>
+
+/*
+    Many shaders (fxc listings or DXBC containers, mixed as they come) in one file, with an index up front,
+    so a capture can be mapped once and any shader in it found in O(1) without touching the others:
+
+        ShaderBundleHeader
+        ShaderBundleEntry[numShaders]
+        shader bytes, each starting 4-byte aligned (DxbcBinary_InitFromContainer wants that)
+
+    Little-endian, offsets are from the start of the file.
+*/
+#define SHADER_BUNDLE_MAGIC "DXSB"
+#define SHADER_BUNDLE_VERSION 1u
+
+struct ShaderBundleHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t numShaders;
+    uint32_t reserved;
+};
+
+struct ShaderBundleEntry {
+    uint64_t offset;
+    uint64_t numBytes;
+    uint64_t hash; // ShaderBundle_Hash of the bytes, to tell shaders apart or check one without translating it
+};
+
+static_assert(sizeof(ShaderBundleHeader) == 16 && sizeof(ShaderBundleEntry) == 24, "on-disk layout");
+
+struct ShaderBundle {
+    MappedFile file;
+    const ShaderBundleEntry *entries;
+    uint32_t numShaders;
+};
+
+// Validates the header and index (not the shaders), the shaders are read straight from the mapping:
+bool ShaderBundle_Open(const char *path, ShaderBundle *bundle);
+void ShaderBundle_Close(ShaderBundle *bundle);
+
+inline const char *
+ShaderBundle_ShaderBegin(const ShaderBundle *bundle, uint32_t index)
+{
+    return bundle->file.pBegin + bundle->entries[index].offset;
+}
+
+inline const char *
+ShaderBundle_ShaderEnd(const ShaderBundle *bundle, uint32_t index)
+{
+    return ShaderBundle_ShaderBegin(bundle, index) + bundle->entries[index].numBytes;
+}
+
+// 64-bit FNV-1a:
+uint64_t ShaderBundle_Hash(const char *pBegin, const char *pEnd);
+
+// Packs whole files in the given order, prints what failed:
+bool ShaderBundle_Write(const char *path, const char *const *shaderPaths, uint32_t numShaders);
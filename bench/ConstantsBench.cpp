@@ -0,0 +1,160 @@
+/*
+    Micro-benchmark: the hashed ConstantsMapScaler32 vs the linear std::vector walk it replaced.
+
+    The keys are the immediate components of a synthetic listing from ShaderGen.h, in the order
+    Codegen would ask for them, cut off once there are 10k distinct constants (or the immediates
+    of the fxc listings given on the command line, all of them). Both maps must hand out the
+    same ids, that is what keeps the emitted constants in the same order.
+
+    Can be built with something like:
+        g++ -std=c++11 -O2 -pthread bench/ConstantsBench.cpp MappedFile.cpp -o constants_bench
+**/
+
+// Pulls in the static tables and functions:
+#include "../DxbcTextScanner.cpp"
+#include "../ConstantsMap.h"
+#include "../MappedFile.h"
+
+#include "ShaderGen.h"
+
+#include <chrono>
+#include <vector>
+
+// What ConstantsMapScaler32 was, a scan of every constant so far per lookup:
+class ConstantsMapLinear {
+    struct Element {
+        uint32_t typeId;
+        uint32_t constkey;
+        uint32_t id;
+    };
+    std::vector<Element> v;
+public:
+    uint32_t *FindElseInsert(uint32_t typeId, uint32_t key, bool *pInserted)
+    {
+        for (Element& elem : v) {
+            if (elem.constkey == key && elem.typeId == typeId) {
+                *pInserted = false;
+                return &elem.id;
+            }
+        }
+        v.push_back(Element{ typeId, key, 0 });
+        *pInserted = true;
+        return &v.back().id;
+    }
+};
+
+enum : uint32_t { TypeIdGenInt32 = 12, NumDistinctConstants = 10000 };
+
+// Module::GetGIntConstantId with either map, ids count up from a made up bound:
+template<class F>
+static uint32_t
+GetIds(F findElseInsert, const std::vector<uint32_t>& keys, std::vector<uint32_t> *ids)
+{
+    uint32_t bound = 100;
+    ids->clear();
+    for (uint32_t key : keys) {
+        bool inserted;
+        uint32_t *const pId = findElseInsert(key, &inserted);
+        if (inserted) {
+            *pId = bound++;
+        }
+        ids->push_back(*pId);
+    }
+    return bound - 100;
+}
+
+template<class F>
+static double
+TimeBest(F once)
+{
+    double best = 1e30;
+    for (uint run = 0; run < 5; ++run) {
+        auto const t0 = std::chrono::steady_clock::now();
+        once();
+        auto const t1 = std::chrono::steady_clock::now();
+        double const seconds = std::chrono::duration<double>(t1 - t0).count();
+        best = seconds < best ? seconds : best;
+    }
+    return best;
+}
+
+static bool
+AppendImmediates(std::vector<uint32_t>& keys, const char *pText, const char *pTextEnd, bool stopAtLimit)
+{
+    DxbcTextScanner scanner;
+    DxbcText_Init(&scanner, pText, pTextEnd);
+    DxbcShader shader;
+    if (DxbcText_Decode(&scanner, &shader) != DxbcTextScanResult::Okay) {
+        return false;
+    }
+
+    ConstantsMapScaler32 distinct;
+    for (const DxbcImmediate& imm : shader.immediates) {
+        for (uint32_t u : imm.u) {
+            if (stopAtLimit && distinct.size() == NumDistinctConstants && distinct.FindElseInsert({ TypeIdGenInt32, u }).inserted) {
+                return true;
+            }
+            distinct.FindElseInsert({ TypeIdGenInt32, u });
+            keys.push_back(u);
+        }
+    }
+    return true;
+}
+
+static bool
+Bench(const char *name, const std::vector<uint32_t>& keys)
+{
+    std::vector<uint32_t> linearIds, hashedIds;
+    uint32_t numLinear = 0, numHashed = 0;
+    double const linearSeconds = TimeBest([&] {
+        ConstantsMapLinear map;
+        numLinear = GetIds([&](uint32_t key, bool *pInserted) { return map.FindElseInsert(TypeIdGenInt32, key, pInserted); },
+                           keys, &linearIds);
+    });
+    double const hashedSeconds = TimeBest([&] {
+        ConstantsMapScaler32 map;
+        numHashed = GetIds([&](uint32_t key, bool *pInserted) {
+            ConstantsMapScaler32::FindElseInsertResult const res = map.FindElseInsert({ TypeIdGenInt32, key });
+            *pInserted = res.inserted;
+            return res.pId;
+        }, keys, &hashedIds);
+    });
+    if (numLinear != numHashed || linearIds != hashedIds) {
+        fprintf(stderr, "%s: the maps disagree on the ids\n", name);
+        return false;
+    }
+    printf("%s: %u lookups, %u distinct constants\n", name, uint(keys.size()), numHashed);
+    printf("  linear %10.3f ms %8.1f ns/lookup\n", linearSeconds * 1e3, linearSeconds * 1e9 / double(keys.size()));
+    printf("  hashed %10.3f ms %8.1f ns/lookup\n", hashedSeconds * 1e3, hashedSeconds * 1e9 / double(keys.size()));
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<uint32_t> keys;
+    if (argc > 1) {
+        for (int i = 1; i < argc; ++i) {
+            MappedFile file;
+            if (!MapFileReadOnly(argv[i], &file)) {
+                return 1;
+            }
+            bool const ok = AppendImmediates(keys, file.pBegin, file.pEnd, false);
+            UnmapFile(&file);
+            if (!ok) {
+                fprintf(stderr, "%s: not a listing the scanner accepts\n", argv[i]);
+                return 1;
+            }
+        }
+        return Bench("listings", keys) ? 0 : 1;
+    }
+
+    ShaderGenOptions options;
+    options.numInstructions = 200000; // plenty, the keys are cut off at NumDistinctConstants
+    options.onlyLowered = true;
+    std::string const text = GenerateListing(options);
+    if (!AppendImmediates(keys, text.data(), text.data() + text.size(), true)) {
+        fprintf(stderr, "generated listing didn't scan\n");
+        return 1;
+    }
+    return Bench("generated", keys) ? 0 : 1;
+}
@@ -0,0 +1,51 @@
+/*
+    Writes a synthetic cs_5_0 listing (see ShaderGen.h), to feed the scanner, ScanBench or the translator.
+
+    usage: gen_shader [numInstructions [numTemps [seed]]] [-lowered] [-o out.txt]
+    -lowered: only instructions the translator handles, use with numTemps <= 256 to translate the output
+
+    Can be built with something like:
+        g++ -std=c++11 -O2 bench/GenShader.cpp -o gen_shader
+**/
+
+#include "ShaderGen.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char **argv)
+{
+    ShaderGenOptions options;
+    const char *outPath = nullptr;
+
+    uint32_t *const positional[] = { &options.numInstructions, &options.numTemps, &options.seed };
+    unsigned numPositional = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            outPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "-lowered") == 0) {
+            options.onlyLowered = true;
+        }
+        else if (numPositional < sizeof positional / sizeof positional[0]) {
+            *positional[numPositional++] = uint32_t(strtoul(argv[i], nullptr, 0));
+        }
+        else {
+            fprintf(stderr, "usage: %s [numInstructions [numTemps [seed]]] [-lowered] [-o out.txt]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::string const text = GenerateListing(options);
+
+    FILE *fp = outPath ? fopen(outPath, "wb") : stdout;
+    if (!fp) {
+        perror(outPath);
+        return 1;
+    }
+    bool const ok = fwrite(text.data(), 1, text.size(), fp) == text.size();
+    if (outPath) {
+        fclose(fp);
+    }
+    return ok ? 0 : 1;
+}
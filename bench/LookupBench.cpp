@@ -0,0 +1,138 @@
+/*
+    Micro-benchmark: perfect-hash LookupInstrInfo vs the linear StringTable walk it replaced.
+
+    Mnemonics are taken from the first word of each line of the fxc listings given
+    on the command line (defaults to the listings in the comments of shaders/).
+
+    Can be built with something like:
+        g++ -std=c++11 -O2 -pthread bench/LookupBench.cpp -o lookup_bench
+**/
+
+// Pulls in the static tables and functions:
+#include "../DxbcTextScanner.cpp"
+
+#include <chrono>
+#include <vector>
+
+static const DxbcInstrStringInfo *
+LookupInstrInfoLinear(ByteView view)
+{
+    for (const DxbcInstrStringInfo& info : StringTable) {
+        if (EqualStrZ(view, info.name)) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+static bool
+AppendFile(std::vector<char>& text, const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return false;
+    }
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof buf, fp)) != 0) {
+        text.insert(text.end(), buf, buf + n);
+    }
+    fclose(fp);
+    text.push_back('\n');
+    return true;
+}
+
+// First identifier of every line between "cs_5_0" and "ret":
+static void
+CollectMnemonics(const std::vector<char>& text, std::vector<ByteView>& out)
+{
+    bool inListing = false;
+    const char *p = text.data();
+    const char *const end = p + text.size();
+    while (p < end) {
+        const char *lineEnd = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!lineEnd) {
+            lineEnd = end;
+        }
+        while (p < lineEnd && (*p == ' ' || *p == '\t')) {
+            ++p;
+        }
+        const char *q = p;
+        while (q < lineEnd && (IsAlphaOrUnderscore(*q) || uint(*q - '0') < 10u)) {
+            ++q;
+        }
+        ByteView word = { p, q };
+        if (!inListing) {
+            inListing = EqualStrZ(word, "cs_5_0");
+        }
+        else if (word.Length()) {
+            out.push_back(word);
+            inListing = !EqualStrZ(word, "ret");
+        }
+        p = lineEnd + 1;
+    }
+}
+
+template<class F>
+static double
+TimeLookups(F lookup, const std::vector<ByteView>& words, uint reps, uint *pNumHits)
+{
+    uint hits = 0;
+    auto const t0 = std::chrono::steady_clock::now();
+    for (uint r = 0; r < reps; ++r) {
+        for (const ByteView& w : words) {
+            hits += lookup(w) != nullptr;
+        }
+    }
+    auto const t1 = std::chrono::steady_clock::now();
+    *pNumHits = hits;
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / (double(reps) * words.size());
+}
+
+int main(int argc, char **argv)
+{
+    static const char *const DefaultFiles[] = {
+        "shaders/add_fiesta.hlsl",
+        "shaders/bool_and.hlsl",
+        "shaders/hello_absneg.hlsl",
+        "shaders/hello_branch.hlsl",
+    };
+
+    std::vector<char> text;
+    if (argc > 1) {
+        for (int i = 1; i < argc; ++i) {
+            AppendFile(text, argv[i]);
+        }
+    }
+    else {
+        for (const char *path : DefaultFiles) {
+            AppendFile(text, path);
+        }
+    }
+
+    std::vector<ByteView> words;
+    CollectMnemonics(text, words);
+    if (words.empty()) {
+        puts("no listings found");
+        return 1;
+    }
+
+    for (const ByteView& w : words) {
+        if (LookupInstrInfo(w) != LookupInstrInfoLinear(w)) {
+            fprintf(stderr, "lookup mismatch: %.*s\n", int(w.Length()), w.pbegin);
+            return 1;
+        }
+    }
+
+    uint const reps = Max(1u, 20000000u / uint(words.size()));
+    uint linearHits, hashHits;
+    double const nsLinear = TimeLookups(LookupInstrInfoLinear, words, reps, &linearHits);
+    double const nsHash = TimeLookups(LookupInstrInfo, words, reps, &hashHits);
+
+    printf("%u mnemonics (%u known), %u table entries, %u hash slots\n",
+           uint(words.size()), hashHits / reps, lengthof(StringTable), PerfectHashSize);
+    printf("linear scan:  %6.2f ns/lookup\n", nsLinear);
+    printf("perfect hash: %6.2f ns/lookup (%.1fx)\n", nsHash, nsLinear / nsHash);
+    return linearHits == hashHits ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+/*
+    Text scanner throughput: MB/s and instructions/s for DxbcText_ScanHeader + DxbcText_ScanInstrInFuncBody
+    (one reused DxbcInstruction, so nothing but the scan), for DxbcText_Decode (which also
+    stores the instruction stream), and for DxbcText_DecodeParallel on all cores.
+
+    Scans the fxc listings given on the command line, or else synthetic listings from
+    ShaderGen.h with dcl_temps 4096 and 1k to 1M instructions.
+
+    Can be built with something like:
+        g++ -std=c++11 -O2 -pthread bench/ScanBench.cpp MappedFile.cpp -o scan_bench
+**/
+
+// Pulls in the static tables and functions:
+#include "../DxbcTextScanner.cpp"
+#include "../MappedFile.h"
+
+#include "ShaderGen.h"
+
+#include <chrono>
+
+struct ScanTiming {
+    double seconds; // best run
+    uint numInstrs;
+};
+
+// Scans the header and body of the listing once, without keeping the instructions:
+static bool
+ScanOnce(const char *pText, const char *pTextEnd, uint *pNumInstrs)
+{
+    DxbcTextScanner scanner;
+    DxbcText_Init(&scanner, pText, pTextEnd);
+
+    DxbcHeaderInfo header;
+    DxbcTextScanResult result = DxbcText_ScanHeader(&scanner, &header);
+
+    Array<DxbcImmediate> immediates;
+    DxbcInstruction instr;
+    uint numInstrs = 0;
+    while (result == DxbcTextScanResult::Okay && !DxbcText_ScanIsEof(&scanner)) {
+        result = DxbcText_ScanInstrInFuncBody(&scanner, &instr, &immediates);
+        numInstrs++;
+    }
+    if (result != DxbcTextScanResult::Okay) {
+        DxbcTextLocation const loc = DxbcText_GetErrorLocation(&scanner);
+        fprintf(stderr, "scan failed at line %u, column %u: %s\n", loc.line, loc.column, scanner.errorMessage);
+        return false;
+    }
+    *pNumInstrs = numInstrs;
+    return true;
+}
+
+static bool
+DecodeOnce(const char *pText, const char *pTextEnd, uint *pNumInstrs)
+{
+    DxbcTextScanner scanner;
+    DxbcText_Init(&scanner, pText, pTextEnd);
+
+    DxbcShader shader;
+    if (DxbcText_Decode(&scanner, &shader) != DxbcTextScanResult::Okay) {
+        return false;
+    }
+    *pNumInstrs = shader.instrs.size();
+    return true;
+}
+
+// One thread per core:
+static bool
+DecodeParallelOnce(const char *pText, const char *pTextEnd, uint *pNumInstrs)
+{
+    DxbcTextScanner scanner;
+    DxbcText_Init(&scanner, pText, pTextEnd);
+
+    DxbcShader shader;
+    if (DxbcText_DecodeParallel(&scanner, &shader, 0) != DxbcTextScanResult::Okay) {
+        return false;
+    }
+    *pNumInstrs = shader.instrs.size();
+    return true;
+}
+
+// Best of a few runs, with enough repetitions per run that small listings don't just time the clock:
+template<class F>
+static bool
+TimeBest(F once, const char *pText, const char *pTextEnd, ScanTiming *timing)
+{
+    uint const reps = uint(Max<ptrdiff_t>(1, (64 << 20) / Max<ptrdiff_t>(1, pTextEnd - pText)));
+    timing->seconds = 1e30;
+    for (uint run = 0; run < 5; ++run) {
+        auto const t0 = std::chrono::steady_clock::now();
+        for (uint r = 0; r < reps; ++r) {
+            if (!once(pText, pTextEnd, &timing->numInstrs)) {
+                return false;
+            }
+        }
+        auto const t1 = std::chrono::steady_clock::now();
+        double const seconds = std::chrono::duration<double>(t1 - t0).count() / reps;
+        timing->seconds = seconds < timing->seconds ? seconds : timing->seconds;
+    }
+    return true;
+}
+
+static void
+PrintTiming(const char *what, size_t numBytes, const ScanTiming& t)
+{
+    printf("  %-8s %8.1f MB/s %8.2f M instr/s\n",
+           what, double(numBytes) / t.seconds * 1e-6, double(t.numInstrs) / t.seconds * 1e-6);
+}
+
+static bool
+BenchListing(const char *name, const char *pText, const char *pTextEnd)
+{
+    ScanTiming scan, decode, parallel;
+    if (!TimeBest(ScanOnce, pText, pTextEnd, &scan) || !TimeBest(DecodeOnce, pText, pTextEnd, &decode) ||
+        !TimeBest(DecodeParallelOnce, pText, pTextEnd, &parallel)) {
+        fprintf(stderr, "%s: not a listing the scanner accepts\n", name);
+        return false;
+    }
+    size_t const numBytes = size_t(pTextEnd - pText);
+    printf("%s: %.2f MB, %u instructions\n", name, double(numBytes) * 1e-6, scan.numInstrs);
+    PrintTiming("scan", numBytes, scan);
+    PrintTiming("decode", numBytes, decode);
+    PrintTiming("parallel", numBytes, parallel);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    bool ok = true;
+    if (argc > 1) {
+        for (int i = 1; i < argc; ++i) {
+            MappedFile file;
+            if (!MapFileReadOnly(argv[i], &file)) {
+                ok = false;
+                continue;
+            }
+            ok &= BenchListing(argv[i], file.pBegin, file.pEnd);
+            UnmapFile(&file);
+        }
+        return ok ? 0 : 1;
+    }
+
+    static const uint32_t Sizes[] = { 1000, 10000, 100000, 1000000 };
+    for (uint32_t numInstructions : Sizes) {
+        ShaderGenOptions options;
+        options.numInstructions = numInstructions;
+        options.numTemps = 4096;
+        std::string const text = GenerateListing(options);
+
+        char name[64];
+        snprintf(name, sizeof name, "generated %u", numInstructions);
+        ok &= BenchListing(name, text.data(), text.data() + text.size());
+    }
+    return ok ? 0 : 1;
+}
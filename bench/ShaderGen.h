@@ -0,0 +1,362 @@
+#pragma once
+
+/*
+    Generates synthetic cs_5_0 listings in the fxc text format, of any size, for benchmarks.
+
+    Uses a mix of the instructions in StringTable, with the operand forms fxc prints
+    (GLSL style and lined up swizzles, l(...) immediates, -/|abs| modifiers, if_nz blocks).
+    Every temp component is written before it is read, and components are only read where
+    Codegen can convert their type. With onlyLowered and up to 256 temps (what VariableEnv holds)
+    the output can be translated too, not just scanned.
+    Same options and seed always give the same listing.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+struct ShaderGenOptions {
+    uint32_t numInstructions = 100000; // in the body, not counting the final store and ret
+    uint32_t numTemps = 64; // 1 to 4096
+    uint32_t seed = 1;
+    bool onlyLowered = false; // leave out instructions Codegen doesn't handle yet (not)
+};
+
+namespace shader_gen {
+
+// xorshift32, not std distributions, so the output is the same everywhere:
+struct Rng {
+    uint32_t state;
+
+    uint32_t Next()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    uint32_t Below(uint32_t n) { return uint32_t((uint64_t(Next()) * n) >> 32); }
+    bool OneIn(uint32_t n) { return Below(n) == 0; }
+};
+
+// Source modifiers that may be put on an operand, abs is only for float sources:
+enum Mods : uint8_t {
+    Mods_None,
+    Mods_Neg,
+    Mods_NegAbs,
+};
+
+// What Codegen will think a temp component holds:
+enum Kind : uint8_t {
+    Kind_Undef = 0,
+    Kind_Int = 1 << 0,
+    Kind_Bool = 1 << 1,
+    Kind_Float = 1 << 2,
+};
+
+struct Generator {
+    Rng rng;
+    std::string out;
+    uint32_t numTemps;
+    std::vector<uint8_t> kinds; // [temp * 4 + comp]
+    std::vector<uint32_t> writtenTemps; // temps with at least one written component
+    bool onlyLowered;
+
+    void Append(const char *s) { out += s; }
+
+    void AppendInt(int32_t v)
+    {
+        char buf[16];
+        snprintf(buf, sizeof buf, "%d", v);
+        out += buf;
+    }
+
+    void AppendTemp(uint32_t temp)
+    {
+        out += 'r';
+        AppendInt(int32_t(temp));
+    }
+
+    int32_t RandomImmediate()
+    {
+        switch (rng.Below(4)) {
+        case 0: return int32_t(rng.Below(4));
+        case 1: return int32_t(rng.Below(32));
+        case 2: return int32_t(rng.Below(100000)) - 50000;
+        default: return int32_t(rng.Next());
+        }
+    }
+
+    // Picks a random write mask, 1 to 4 components:
+    uint32_t RandomWriteMask()
+    {
+        static const uint8_t Masks[] = { 1, 2, 4, 8, 1, 2, 4, 8, 3, 6, 12, 7, 14, 15, 15, 5, 9, 10, 11, 13 };
+        return Masks[rng.Below(sizeof Masks)];
+    }
+
+    /*
+        Writes one source operand for the components in writeMask.
+        lined up: 4 swizzle chars, only the ones in writeMask matter (like "r1.xyxx" for dst.xy).
+        else GLSL style: one swizzle char per written component.
+        Only reads temp components of a kind in allowedKinds, falls back to vThreadID.x
+        (an int) or an immediate when no written temp fits.
+    */
+    void AppendSrc(uint32_t writeMask, bool linedUp, uint32_t allowedKinds, bool allowImmediate, Mods mods)
+    {
+        static const char Comps[] = "xyzw";
+        uint32_t const choice = rng.Below(10);
+
+        if (allowImmediate && choice < 3) {
+            Append("l(");
+            if (linedUp) {
+                for (uint32_t c = 0; c < 4; ++c) {
+                    AppendInt(writeMask & 1u << c ? RandomImmediate() : 0);
+                    Append(c < 3 ? ", " : ")");
+                }
+            }
+            else {
+                bool first = true;
+                for (uint32_t c = 0; c < 4; ++c) {
+                    if (writeMask & 1u << c) {
+                        Append(first ? "" : ", ");
+                        AppendInt(RandomImmediate());
+                        first = false;
+                    }
+                }
+                Append(")");
+            }
+            return;
+        }
+
+        bool abs = false;
+        if (mods != Mods_None && rng.OneIn(8)) {
+            Append("-");
+        }
+        if (mods == Mods_NegAbs && rng.OneIn(16)) {
+            Append("|");
+            abs = true;
+        }
+
+        // a written temp that has a component of an allowed kind:
+        uint32_t temp = ~0u;
+        for (uint32_t tries = 0; tries < 4 && !writtenTemps.empty() && choice >= 4; ++tries) {
+            uint32_t const t = writtenTemps[rng.Below(uint32_t(writtenTemps.size()))];
+            for (uint32_t c = 0; c < 4; ++c) {
+                if (kinds[t * 4 + c] & allowedKinds) {
+                    temp = t;
+                }
+            }
+            if (temp != ~0u) {
+                break;
+            }
+        }
+
+        if (temp == ~0u) {
+            Append("vThreadID.");
+            for (uint32_t c = 0; c < 4; ++c) {
+                if (linedUp || (writeMask & 1u << c)) {
+                    out += 'x';
+                }
+            }
+            Append(abs ? "|" : "");
+            return;
+        }
+
+        AppendTemp(temp);
+        out += '.';
+        for (uint32_t c = 0; c < 4; ++c) {
+            if (!linedUp && !(writeMask & 1u << c)) {
+                continue;
+            }
+            uint32_t comp;
+            do {
+                comp = rng.Below(4);
+            } while (!(kinds[temp * 4 + comp] & allowedKinds));
+            out += Comps[comp];
+        }
+        Append(abs ? "|" : "");
+    }
+
+    void AppendDst(uint32_t temp, uint32_t writeMask)
+    {
+        static const char Comps[] = "xyzw";
+        AppendTemp(temp);
+        out += '.';
+        for (uint32_t c = 0; c < 4; ++c) {
+            if (writeMask & 1u << c) {
+                out += Comps[c];
+            }
+        }
+    }
+
+    void SetKind(uint32_t temp, uint32_t writeMask, Kind kind)
+    {
+        bool wasWritten = false;
+        for (uint32_t c = 0; c < 4; ++c) {
+            wasWritten |= kinds[temp * 4 + c] != Kind_Undef;
+            if (writeMask & 1u << c) {
+                kinds[temp * 4 + c] = kind;
+            }
+        }
+        if (!wasWritten) {
+            writtenTemps.push_back(temp);
+        }
+    }
+
+    void AppendInstruction()
+    {
+        uint32_t const AnyKind = Kind_Int | Kind_Bool | Kind_Float;
+        uint32_t const dst = rng.Below(numTemps);
+        uint32_t writeMask = RandomWriteMask();
+        // GLSL style swizzles need a contiguous-ish mask, and 1 component is always printed that way:
+        bool const linedUp = !(writeMask == 1 || writeMask == 2 || writeMask == 4 || writeMask == 8) &&
+            (writeMask == 5 || writeMask == 9 || writeMask == 10 || rng.OneIn(2));
+
+        uint32_t const op = rng.Below(100);
+        if (op < 12) {
+            Append("mov ");
+            AppendDst(dst, writeMask);
+            Append(", ");
+            // mov keeps the kind of what it reads, keep it simple and only move ints:
+            AppendSrc(writeMask, linedUp, Kind_Int, true, Mods_None);
+            SetKind(dst, writeMask, Kind_Int);
+        }
+        else if (op < 40) {
+            static const char *const IntOps[] = { "iadd", "iadd", "iadd", "and", "or", "xor", "ishl" };
+            const char *const name = IntOps[rng.Below(sizeof IntOps / sizeof IntOps[0])];
+            bool const isAdd = name[0] == 'i' && name[1] == 'a';
+            Append(name);
+            Append(" ");
+            AppendDst(dst, writeMask);
+            Append(", ");
+            AppendSrc(writeMask, linedUp, Kind_Int | Kind_Float, true, isAdd ? Mods_Neg : Mods_None);
+            Append(", ");
+            AppendSrc(writeMask, linedUp, Kind_Int | Kind_Float, true, isAdd ? Mods_Neg : Mods_None);
+            SetKind(dst, writeMask, Kind_Int);
+        }
+        else if (op < 45 && !onlyLowered) {
+            Append("not ");
+            AppendDst(dst, writeMask);
+            Append(", ");
+            AppendSrc(writeMask, linedUp, Kind_Int, false, Mods_None);
+            SetKind(dst, writeMask, Kind_Int);
+        }
+        else if (op < 55) {
+            static const char *const CmpOps[] = { "ult", "uge", "ieq" };
+            Append(CmpOps[rng.Below(3)]);
+            Append(" ");
+            AppendDst(dst, writeMask);
+            Append(", ");
+            AppendSrc(writeMask, linedUp, Kind_Int, false, Mods_None);
+            Append(", ");
+            AppendSrc(writeMask, linedUp, Kind_Int, true, Mods_None);
+            SetKind(dst, writeMask, Kind_Bool);
+        }
+        else if (op < 65) {
+            Append("movc ");
+            AppendDst(dst, writeMask);
+            Append(", ");
+            AppendSrc(writeMask, linedUp, Kind_Int | Kind_Bool, false, Mods_None);
+            Append(", ");
+            AppendSrc(writeMask, linedUp, Kind_Int, true, Mods_None);
+            Append(", ");
+            AppendSrc(writeMask, linedUp, Kind_Int, true, Mods_None);
+            SetKind(dst, writeMask, Kind_Int);
+        }
+        else if (op < 75) {
+            Append("imad ");
+            AppendDst(dst, writeMask);
+            Append(", ");
+            AppendSrc(writeMask, linedUp, Kind_Int, false, Mods_None);
+            Append(", ");
+            AppendSrc(writeMask, linedUp, Kind_Int, true, Mods_None);
+            Append(", ");
+            AppendSrc(writeMask, linedUp, Kind_Int, true, Mods_None);
+            SetKind(dst, writeMask, Kind_Int);
+        }
+        else if (op < 85) {
+            Append("add ");
+            AppendDst(dst, writeMask);
+            Append(", ");
+            AppendSrc(writeMask, linedUp, Kind_Int | Kind_Float, false, Mods_NegAbs);
+            Append(", ");
+            AppendSrc(writeMask, linedUp, Kind_Int | Kind_Float, false, Mods_NegAbs);
+            SetKind(dst, writeMask, Kind_Float);
+        }
+        else if (op < 92) {
+            writeMask = 15;
+            Append("ld_uav_typed_indexable(buffer)(uint,uint,uint,uint) ");
+            AppendDst(dst, writeMask);
+            Append(", ");
+            AppendSrc(1, true, Kind_Int, false, Mods_None);
+            Append(", u0.xyzw");
+            SetKind(dst, writeMask, Kind_Int);
+        }
+        else {
+            Append("store_uav_typed u0.xyzw, ");
+            AppendSrc(1, true, Kind_Int, false, Mods_None);
+            Append(", ");
+            AppendSrc(15, true, AnyKind, false, Mods_None);
+        }
+        Append("\n");
+    }
+
+    void Generate(const ShaderGenOptions& options)
+    {
+        numTemps = options.numTemps < 1 ? 1 : options.numTemps > 4096 ? 4096 : options.numTemps;
+        rng.state = options.seed ? options.seed : 1;
+        onlyLowered = options.onlyLowered;
+        kinds.assign(numTemps * 4, Kind_Undef);
+        out.reserve(size_t(options.numInstructions) * 48 + 256);
+
+        Append("cs_5_0\n"
+               "dcl_globalFlags refactoringAllowed\n"
+               "dcl_uav_typed_buffer (uint,uint,uint,uint) u0\n"
+               "dcl_input vThreadID.x\n"
+               "dcl_temps ");
+        AppendInt(int32_t(numTemps));
+        Append("\ndcl_thread_group 64, 1, 1\n");
+
+        uint32_t ifDepth = 0;
+        bool inElse[8] = {};
+        for (uint32_t i = 0; i < options.numInstructions; ++i) {
+            uint32_t const r = rng.Below(64);
+            if (r == 0 && ifDepth < 8) {
+                Append("if_nz ");
+                AppendSrc(1, false, Kind_Int | Kind_Bool, false, Mods_None);
+                Append("\n");
+                inElse[ifDepth++] = false;
+            }
+            else if (r == 1 && ifDepth && !inElse[ifDepth - 1]) {
+                Append("else\n");
+                inElse[ifDepth - 1] = true;
+            }
+            else if (r == 2 && ifDepth) {
+                Append("endif\n");
+                ifDepth--;
+            }
+            else {
+                AppendInstruction();
+            }
+        }
+        while (ifDepth) {
+            Append("endif\n");
+            ifDepth--;
+        }
+        Append("store_uav_typed u0.xyzw, vThreadID.xxxx, ");
+        AppendSrc(15, true, Kind_Int | Kind_Bool | Kind_Float, false, Mods_None);
+        Append("\nret\n");
+    }
+};
+
+} // namespace shader_gen
+
+static std::string
+GenerateListing(const ShaderGenOptions& options)
+{
+    shader_gen::Generator gen;
+    gen.Generate(options);
+    return std::move(gen.out);
+}
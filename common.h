@@ -23,10 +23,14 @@ __forceinline static unsigned long bsf(unsigned long v)
     _BitScanForward(&i, v);
     return i;
 }
+extern "C" unsigned int __popcnt(unsigned int);
+#pragma intrinsic(__popcnt)
+#define popcnt(v) unsigned(__popcnt(v))
 #else
 #define unreachable __builtin_unreachable()
 #define attrib_noreturn __attribute__((noreturn))
 #define bsf(v) unsigned(__builtin_ctz(v))
+#define popcnt(v) unsigned(__builtin_popcount(v))
 #endif
 
 template<class T>
@@ -73,10 +77,24 @@ inline constexpr char_view operator""_view(const char *strlit, size_t n) noexcep
     return { strlit, uint(n) };
 }
 
+template<class T> constexpr T Min(T a, T b) { return b < a ? b : a; }
 template<class T> constexpr T Max(T a, T b) { return a < b ? b : a; }
 
 template<class T, uint N> constexpr uint lengthof(T(&)[N]) { return N; }
 
+// Compile-time list of 0..N-1, for building constexpr tables with a pack expansion.
+// Halving, so the template depth is log2(N) instead of N:
+template<uint... Is> struct IndexList { typedef IndexList type; };
+
+template<class A, class B> struct ConcatIndexList;
+template<uint... As, uint... Bs> struct ConcatIndexList<IndexList<As...>, IndexList<Bs...>>
+    : IndexList<As..., (sizeof...(As) + Bs)...> { };
+
+template<uint N> struct MakeIndexList
+    : ConcatIndexList<typename MakeIndexList<N / 2>::type, typename MakeIndexList<N - N / 2>::type> { };
+template<> struct MakeIndexList<0> : IndexList<> { };
+template<> struct MakeIndexList<1> : IndexList<0> { };
+
 template<class T>
 void Swap(T &a, T &b)
 {
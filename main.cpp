@@ -8,14 +8,19 @@
 **/
 
 #include <stdio.h>
+#include <string.h>
 
 #include "common.h"
 
-#include <vector>
+#include <memory>
 
 #include "DxbcTextScanner.h"
+#include "DxbcBinaryScanner.h"
+#include "MappedFile.h"
+#include "ShaderBundle.h"
 
 #include "Array.h"
+#include "ConstantsMap.h"
 
 #include "SpirvRunner.h"
 
@@ -26,40 +31,6 @@
 
 typedef Array<uint32_t> SpirvDynamicArray;
 
-// does not support removal
-// pointers are not stable
-class ConstantsMapScaler32 {
-public:
-    struct Element {
-        uint32_t constkey; // key of table
-        SpvId id;
-    };
-    typedef std::vector<Element>::const_iterator iter;
-
-    struct FindElseInsertResult {
-        SpvId *pId; // caller fills this in after knowing insrt was succesful
-        bool inserted;
-    };
-
-private:
-    std::vector<Element> v;
-public:
-    uint size() const { return uint(v.size()); }
-    iter begin() const { return v.cbegin(); }
-    iter end() const { return v.cend(); }
-
-    FindElseInsertResult FindElseInsert(uint32_t key)
-    {
-        for (Element& elem : v) {
-            if (elem.constkey == key) {
-                return { &elem.id, false };
-            }
-        }
-        v.push_back(Element{ key, 0 });
-        return { &v.back().id, true };
-    }
-};
-
 /*
 Note: The "Gen" or "G" in int means generic, and means
 OpTypeInt with a "signedness" of 0.
@@ -106,6 +77,8 @@ struct BasicBlock {
     Array<uint32_t> code;
 };
 
+struct LoopContext;
+
 struct Function {
     // Descriptor values and input-file values (not pointers) are
     // handled like constant IDs, but these
@@ -119,13 +92,78 @@ struct Function {
     // SpvId uav_ids[64] = {};
 
     SpvId vThreadIDInGroupFlattened_id = 0;
+
+    // Label of the block code is being emitted into, for the parents of OpPhi at a merge:
+    SpvId currentBlockId = 0;
+    // Target of break/continue, null outside of loops:
+    LoopContext *innermostLoop = nullptr;
+};
+
+// A side-effect free instruction, by what it computes, unused operands are 0:
+struct InstructionKey {
+    uint32_t op;
+    uint32_t typeId; // of the result
+    uint32_t operands[3];
+
+    uint64_t HashInput() const
+    {
+        uint64_t h = uint64_t(op) << 32 | typeId;
+        for (uint32_t id : operands) {
+            h = (h ^ id) * 0x100000001B3ull;
+        }
+        return h;
+    }
+    bool operator==(const InstructionKey& other) const { return memcmp(this, &other, sizeof *this) == 0; }
 };
 
+/*
+    Local value numbering: the ids of the instructions emitted in the current basic block, by
+    InstructionKey, so computing the same thing again in the block reuses the id.
+
+    The current block is the one at the end of the code array last emitted into. The values are forgotten
+    when emitting into another array (the arms of an if are lowered into their own), and when an OpLabel
+    went into the array since, then they don't dominate what comes next.
+**/
+class ValueNumbering {
+    ConstantsMap<InstructionKey> values;
+    const SpirvDynamicArray *pCode = nullptr;
+    uint scannedSize = 0; // the words of *pCode from before are known to be in the current block, or before it
+
+public:
+    typedef ConstantsMap<InstructionKey>::FindElseInsertResult FindElseInsertResult;
+
+    // About to emit into code, *pId is 0 for an instruction not there yet, the caller fills it in:
+    FindElseInsertResult FindElseInsert(const SpirvDynamicArray& code, const InstructionKey& key)
+    {
+        bool newBlock = pCode != &code;
+        ASSERT(newBlock || scannedSize <= code.size());
+        const uint32_t *const words = code.data();
+        for (uint i = newBlock ? code.size() : scannedSize; i < code.size(); i += words[i] >> 16) {
+            newBlock = newBlock || (words[i] & 0xFFFFu) == SpvOpLabel;
+        }
+        if (newBlock) {
+            values.Clear();
+            pCode = &code;
+        }
+        scannedSize = code.size();
+        return values.FindElseInsert(key);
+    }
+
+    // Before the array emitted into goes away, another one could take its place:
+    void Forget() { pCode = nullptr; }
+};
 
 struct Module {
     DxbcHeaderInfo dxbcHeaderInfo;
+    const DxbcImmediate *dxbcImmediates = nullptr; // indexed by slotInFile of immediate operands
+
+    ConstantsMapScaler32 scalarConstants;
+    ConstantsMapComposite compositeConstants;
+    // By the id of a constant: 1 + its index in scalarConstants, or in compositeConstants | CompositeConstantIndexBit
+    ConstantsMap<SpvIdKey> constantIndices;
+    ValueNumbering valueNumbers;
 
-    ConstantsMapScaler32 gint32Constants;
+    enum : uint32_t { CompositeConstantIndexBit = 1u << 31 };
 
     //bound = idinfo.size();
     // std::vector<SpirvIdInfo> idInfo;
@@ -159,6 +197,15 @@ struct Module {
         return id;
     }
 
+    // The whole OpLoad of vThreadID, that Get_vThreadID_c_id extracts from:
+    SpvId Get_vThreadID_id(Function *fn)
+    {
+        if (!fn->vThreadID_xyx_id) {
+            fn->vThreadID_xyx_id = this->_bound++;
+        }
+        return fn->vThreadID_xyx_id;
+    }
+
     SpvId Get_vThreadIDInGroupFlattened_id(Function *fn)
     {
         SpvId id = fn->vThreadIDInGroupFlattened_id;
@@ -169,18 +216,84 @@ struct Module {
         return id;
     }
 
-    SpvId GetGIntConstantId(uint32_t key)
+    // typeId is one of StaticSpvId_Type{GenInt32,Float32,Bool}, bits is 0/1 for bools:
+    SpvId GetScalarConstantId(SpvId typeId, uint32_t bits)
+    {
+        ASSERT(typeId == StaticSpvId_TypeGenInt32 || typeId == StaticSpvId_TypeFloat32 || (typeId == StaticSpvId_TypeBool && bits <= 1u));
+        ConstantsMapScaler32::FindElseInsertResult res = this->scalarConstants.FindElseInsert({ typeId, bits });
+        if (res.inserted) {
+            SpvId id = this->_bound++;
+            *res.pId = id;
+            *this->constantIndices.FindElseInsert({ id }).pId = this->scalarConstants.size();
+            return id;
+        }
+        else {
+            return *res.pId;
+        }
+    }
+
+    SpvId GetGIntConstantId(uint32_t key) { return GetScalarConstantId(StaticSpvId_TypeGenInt32, key); }
+    SpvId GetFloatConstantId(uint32_t bits) { return GetScalarConstantId(StaticSpvId_TypeFloat32, bits); }
+    SpvId GetBoolConstantId(bool value) { return GetScalarConstantId(StaticSpvId_TypeBool, value); }
+
+    // vectorTypeId is a StaticSpvId_TypeV{2,3,4}*, the components are constants of its scalar type:
+    SpvId GetCompositeConstantId(SpvId vectorTypeId, const SpvId *componentIds)
     {
-        ConstantsMapScaler32::FindElseInsertResult res = this->gint32Constants.FindElseInsert(key);
+        ASSERT(vectorTypeId >= StaticSpvId_TypeBool && vectorTypeId < StaticSpvId_End && (vectorTypeId & 3u));
+        CompositeConstantKey key = { vectorTypeId, {} };
+        memcpy(key.componentIds, componentIds, ((vectorTypeId & 3u) + 1) * sizeof(SpvId));
+        ConstantsMapComposite::FindElseInsertResult res = this->compositeConstants.FindElseInsert(key);
         if (res.inserted) {
             SpvId id = this->_bound++;
             *res.pId = id;
+            *this->constantIndices.FindElseInsert({ id }).pId = this->compositeConstants.size() | CompositeConstantIndexBit;
             return id;
         }
         else {
             return *res.pId;
         }
     }
+
+    // typeId is a scalar or vector static type, bits has a word per component (0 or 1 for bools):
+    SpvId GetConstantId(SpvId typeId, const uint32_t *bits)
+    {
+        if (!(typeId & 3u)) {
+            return GetScalarConstantId(typeId, bits[0]);
+        }
+        SpvId componentIds[4];
+        for (uint i = 0; i <= (typeId & 3u); ++i) {
+            componentIds[i] = GetScalarConstantId(typeId & ~3u, bits[i]);
+        }
+        return GetCompositeConstantId(typeId, componentIds);
+    }
+
+    // The constant has bits in every component:
+    SpvId GetSplatConstantId(SpvId typeId, uint32_t bits)
+    {
+        uint32_t const splat[4] = { bits, bits, bits, bits };
+        return GetConstantId(typeId, splat);
+    }
+
+    // False if id isn't a constant, else its static type and the bits of each component (0 or 1 for bools):
+    bool GetConstantBits(SpvId id, SpvId *pTypeId, uint32_t *bits) const
+    {
+        uint32_t const index = this->constantIndices.Find({ id });
+        if (!index) {
+            return false;
+        }
+        if (!(index & CompositeConstantIndexBit)) {
+            const ConstantsMapScaler32::Element& e = this->scalarConstants.begin()[index - 1];
+            *pTypeId = e.key.typeId;
+            bits[0] = e.key.bits;
+            return true;
+        }
+        const ConstantsMapComposite::Element& e = this->compositeConstants.begin()[(index & ~CompositeConstantIndexBit) - 1];
+        *pTypeId = e.key.typeId;
+        for (uint i = 0; i <= (e.key.typeId & 3u); ++i) {
+            bits[i] = this->scalarConstants.begin()[this->constantIndices.Find({ e.key.componentIds[i] }) - 1].key.bits;
+        }
+        return true;
+    }
 };
 
 // ------------------------------------------------------------------------------------------------
@@ -238,11 +351,117 @@ static void EmitDecorateBuiltin(Array<uint32_t>& code, SpvId id, SpvBuiltIn buil
     code.push_initlist({ SpvOpDecorate | 4 << 16, id, SpvDecorationBuiltIn, uint32_t(builtinEnum) });
 }
 
+static bool
+IsCommutative(SpvOp op)
+{
+    switch (op) {
+    case SpvOpIAdd:
+    case SpvOpFAdd:
+    case SpvOpIMul:
+    case SpvOpFMul:
+    case SpvOpBitwiseOr:
+    case SpvOpBitwiseXor:
+    case SpvOpBitwiseAnd:
+    case SpvOpIEqual:
+    case SpvOpINotEqual:
+    case SpvOpLogicalOr:
+    case SpvOpLogicalAnd:
+    case SpvOpLogicalEqual:
+    case SpvOpLogicalNotEqual:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+    Constant folding, in front of the Emit* functions: when the operands are constants the result is
+    one too, no instruction. The integer ops are evaluated like DXBC would (a shift uses the low 5 bits),
+    and bools are 0/1, so the compares and selects that convert them to -1/0 ints and back fold too.
+    Float arithmetic isn't folded, that's rounding the GPU would do.
+**/
+static bool
+FoldBinOp(Module& m, SpvOp op, SpvId resultTypeId, SpvId a, SpvId b, SpvId *pResult)
+{
+    SpvId aTypeId, bTypeId;
+    uint32_t x[4], y[4];
+    if (!m.GetConstantBits(a, &aTypeId, x) || !m.GetConstantBits(b, &bTypeId, y)) {
+        return false;
+    }
+    uint32_t r[4];
+    for (uint i = 0; i <= (resultTypeId & 3u); ++i) {
+        switch (op) {
+        case SpvOpIAdd: r[i] = x[i] + y[i]; break;
+        case SpvOpISub: r[i] = x[i] - y[i]; break;
+        case SpvOpIMul: r[i] = x[i] * y[i]; break;
+        case SpvOpBitwiseAnd:
+        case SpvOpLogicalAnd: r[i] = x[i] & y[i]; break;
+        case SpvOpBitwiseOr:
+        case SpvOpLogicalOr: r[i] = x[i] | y[i]; break;
+        case SpvOpBitwiseXor:
+        case SpvOpLogicalNotEqual: r[i] = x[i] ^ y[i]; break;
+        case SpvOpShiftLeftLogical: r[i] = x[i] << (y[i] & 31u); break;
+        case SpvOpIEqual:
+        case SpvOpLogicalEqual: r[i] = x[i] == y[i]; break;
+        case SpvOpINotEqual: r[i] = x[i] != y[i]; break;
+        case SpvOpULessThan: r[i] = x[i] < y[i]; break;
+        case SpvOpUGreaterThanEqual: r[i] = x[i] >= y[i]; break;
+        default: return false;
+        }
+    }
+    *pResult = m.GetConstantId(resultTypeId, r);
+    return true;
+}
+
+// A constant condition picks one side, for vectors with constant sides too if the condition isn't the same for all:
+static bool
+FoldSelect(Module& m, SpvId resultTypeId, SpvId cond, SpvId t, SpvId f, SpvId *pResult)
+{
+    SpvId condTypeId, tTypeId, fTypeId;
+    uint32_t c[4], x[4], y[4];
+    if (t == f) {
+        *pResult = t;
+        return true;
+    }
+    if (!m.GetConstantBits(cond, &condTypeId, c)) {
+        return false;
+    }
+    uint const n = (resultTypeId & 3u) + 1;
+    bool allSame = true;
+    for (uint i = 1; i < n; ++i) {
+        allSame = allSame && c[i] == c[0];
+    }
+    if (allSame) {
+        *pResult = c[0] ? t : f;
+        return true;
+    }
+    if (!m.GetConstantBits(t, &tTypeId, x) || !m.GetConstantBits(f, &fTypeId, y)) {
+        return false;
+    }
+    for (uint i = 0; i < n; ++i) {
+        x[i] = c[i] ? x[i] : y[i];
+    }
+    *pResult = m.GetConstantId(resultTypeId, x);
+    return true;
+}
+
 static SpvId
 EmitBinOp(Module& m, Array<uint32_t>& code, SpvOp op, SpvId resultTypeId, SpvId a, SpvId b)
 {
+    SpvId folded;
+    if (FoldBinOp(m, op, resultTypeId, a, b, &folded)) {
+        return folded;
+    }
+    if (IsCommutative(op) && b < a) {
+        Swap(a, b); // so b op a is the same value
+    }
+    ValueNumbering::FindElseInsertResult const res = m.valueNumbers.FindElseInsert(code, { op, resultTypeId, { a, b, 0 } });
+    if (!res.inserted) {
+        return *res.pId;
+    }
     uint32_t *p = code.uninitialized_push_n(5);
     SpvId dstValueId = m.AllocId();
+    *res.pId = dstValueId;
     p[0] = op | 5 << 16;
     p[1] = resultTypeId;
     p[2] = dstValueId;
@@ -251,15 +470,35 @@ EmitBinOp(Module& m, Array<uint32_t>& code, SpvOp op, SpvId resultTypeId, SpvId
     return dstValueId;
 }
 
-static void EmitScalarConstants(Array<uint32_t>& code, const ConstantsMapScaler32& constants, SpvId typeId)
+// In the order they were first used, so the output doesn't depend on the hashing:
+static void EmitScalarConstants(Array<uint32_t>& code, const ConstantsMapScaler32& constants, const Array<uint8_t>& live)
 {
-    uint32_t *p = code.uninitialized_push_n(constants.size() * 4);
     for (const ConstantsMapScaler32::Element& e : constants) {
-        p[0] = SpvOpConstant | 4 << 16;
-        p[1] = typeId;
+        if (!live.data()[e.id]) {
+            continue;
+        }
+        if (e.key.typeId == StaticSpvId_TypeBool) {
+            code.push3((e.key.bits ? SpvOpConstantTrue : SpvOpConstantFalse) | 3 << 16, e.key.typeId, e.id);
+        }
+        else {
+            code.push4(SpvOpConstant | 4 << 16, e.key.typeId, e.id, e.key.bits);
+        }
+    }
+}
+
+// After the scalars, the components are always scalar constants:
+static void EmitCompositeConstants(Array<uint32_t>& code, const ConstantsMapComposite& constants, const Array<uint8_t>& live)
+{
+    for (const ConstantsMapComposite::Element& e : constants) {
+        if (!live.data()[e.id]) {
+            continue;
+        }
+        uint const numComponents = (e.key.typeId & 3u) + 1;
+        uint32_t *p = code.uninitialized_push_n(3 + numComponents);
+        p[0] = SpvOpConstantComposite | (3 + numComponents) << 16;
+        p[1] = e.key.typeId;
         p[2] = e.id;
-        p[3] = e.constkey;
-        p += 4;
+        memcpy(p + 3, e.key.componentIds, numComponents * sizeof(uint32_t));
     }
 }
 
@@ -272,16 +511,41 @@ static void EmitDecorateSetAndBinding(Array<uint32_t>& code, SpvId id, uint set,
 
 static SpvId EmitBitcast(Module& m, Array<uint32_t>& code, SpvId dstTypeId, SpvId srcValueId)
 {
-    SpvId resultId = m.AllocId();
-    code.push4(SpvOpBitcast | 4 << 16, dstTypeId, resultId, srcValueId);
-    return resultId;
+    SpvId srcTypeId;
+    uint32_t bits[4];
+    if (m.GetConstantBits(srcValueId, &srcTypeId, bits)) {
+        return m.GetConstantId(dstTypeId, bits); // same bits, the other type
+    }
+    ValueNumbering::FindElseInsertResult const res = m.valueNumbers.FindElseInsert(code, { SpvOpBitcast, dstTypeId, { srcValueId, 0, 0 } });
+    if (res.inserted) {
+        *res.pId = m.AllocId();
+        code.push4(SpvOpBitcast | 4 << 16, dstTypeId, *res.pId, srcValueId);
+    }
+    return *res.pId;
 }
 
 static SpvId EmitSelect(Module& m, Array<uint32_t>& code, SpvId dstTypeId, SpvId cond, SpvId t, SpvId f)
 {
-    SpvId resultId = m.AllocId();
-    code.push_initlist({ SpvOpSelect | 6 << 16, dstTypeId, resultId, cond, t, f });
-    return resultId;
+    SpvId folded;
+    if (FoldSelect(m, dstTypeId, cond, t, f, &folded)) {
+        return folded;
+    }
+    ValueNumbering::FindElseInsertResult const res = m.valueNumbers.FindElseInsert(code, { SpvOpSelect, dstTypeId, { cond, t, f } });
+    if (res.inserted) {
+        *res.pId = m.AllocId();
+        code.push_initlist({ SpvOpSelect | 6 << 16, dstTypeId, *res.pId, cond, t, f });
+    }
+    return *res.pId;
+}
+
+static SpvId EmitCompositeExtract(Module& m, Array<uint32_t>& code, SpvId dstTypeId, SpvId compositeId, uint index)
+{
+    ValueNumbering::FindElseInsertResult const res = m.valueNumbers.FindElseInsert(code, { SpvOpCompositeExtract, dstTypeId, { compositeId, index, 0 } });
+    if (res.inserted) {
+        *res.pId = m.AllocId();
+        code.push_initlist({ SpvOpCompositeExtract | 5 << 16, dstTypeId, *res.pId, compositeId, index });
+    }
+    return *res.pId;
 }
 
 // ---------------------------------------------------------------------------------------------
@@ -344,23 +608,16 @@ struct SpirvOpInfo {
     }
 };
 
+static const SpirvOpInfo SpirvOpInfoTable[] = {
+#define DXBC_INSTR_SPIRV_OP_INFO(tag, mnemonic, cls, sbOp, spvOp, spvOpClass, lower) { SpvOp##spvOp, SpirvOpClass::spvOpClass },
+    DXBC_INSTRUCTIONS(DXBC_INSTR_SPIRV_OP_INFO)
+#undef DXBC_INSTR_SPIRV_OP_INFO
+};
+
 static SpirvOpInfo GetSpirvOpInfo(DxbcInstrTag dxbcTag)
 {
-    switch (dxbcTag) {
-    case DxbcInstrTag::iand: return { SpvOpBitwiseAnd, SpirvOpClass::int_common };
-    case DxbcInstrTag::ior: return { SpvOpBitwiseOr, SpirvOpClass::int_common };
-    case DxbcInstrTag::ixor: return { SpvOpBitwiseXor, SpirvOpClass::int_common };
-    case DxbcInstrTag::inot: return { SpvOpNot, SpirvOpClass::int_common };
-    case DxbcInstrTag::iadd: return { SpvOpIAdd, SpirvOpClass::int_common };
-    case DxbcInstrTag::add: return { SpvOpFAdd, SpirvOpClass::float_common };
-    case DxbcInstrTag::movc: return { SpvOpSelect, SpirvOpClass::select_generic };
-    case DxbcInstrTag::uge: return { SpvOpUGreaterThanEqual, SpirvOpClass::int_cmp };
-    case DxbcInstrTag::ult: return { SpvOpULessThan, SpirvOpClass::int_cmp };
-    case DxbcInstrTag::ieq: return { SpvOpIEqual, SpirvOpClass::int_cmp };
-    case DxbcInstrTag::ishl: return { SpvOpShiftLeftLogical, SpirvOpClass::int_common };
-    default:
-        return {};
-    }
+    ASSERT(uint(dxbcTag) < lengthof(SpirvOpInfoTable));
+    return SpirvOpInfoTable[uint(dxbcTag)];
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -374,14 +631,16 @@ struct PackedValueAndType {
 
 // Local Value Numbering
 //
-// Haven't got to the hashtable/previous value reuse part yet.
-// Think that could be nice to potentially reduce bitcasts, int<->bool conversions, and abs/neg.
-// May not be worth doing it for much else.
+// The hashtable/previous value reuse part is ValueNumbering, in the Emit* functions, for the
+// bitcasts, int<->bool conversions and ALU ops. (Not abs/neg yet.)
 //
 // The more helpful part is associating dxbc vars with a value, so don't have to do
 // a bunch of OpLoad/OpStore in the middle of a basic block.
 struct VariableEnv {
     PackedValueAndType varArrayMap[256][4] = { }; // 4 components per reg. XXX: max temp regs is 4096
+    // A component written by a vectorized instruction is a lane of its result: varArrayMap has the vector's id and
+    // component type, and this is PackVectorLane(lane, width). 0 for a component that is a scalar value.
+    uint8_t vectorLanes[256][4] = { };
 
     SpvId CurrentTypeIdOfTempVar(uint writeMaskComp, const DxbcOperand& src) const
     {
@@ -389,8 +648,24 @@ struct VariableEnv {
         uint comp = src.srcSwizzle[writeMaskComp];
         return varArrayMap[src.slotInFile][comp].spvStaticTypeId;
     }
+
+    void SetScalar(uint slot, uint comp, SpvId valueId, SpvId typeId)
+    {
+        varArrayMap[slot][comp] = { valueId, typeId };
+        vectorLanes[slot][comp] = 0;
+    }
 };
 
+static uint8_t
+PackVectorLane(uint lane, uint width)
+{
+    ASSERT(lane < width && width - 2u < 3u);
+    return uint8_t(1u + lane + 4u * (width - 1u));
+}
+
+static uint VectorLaneIndex(uint8_t packed) { return (packed - 1u) & 3u; }
+static uint VectorLaneWidth(uint8_t packed) { return ((packed - 1u) >> 2) + 1u; }
+
 static void WriteVariable(VariableEnv &env, uint comp, const DxbcOperand& dst, SpvId valueId, SpvId typeId)
 {
     ASSERT(uint(typeId) < StaticSpvId_End);
@@ -399,7 +674,7 @@ static void WriteVariable(VariableEnv &env, uint comp, const DxbcOperand& dst, S
         uint const slot = uint(dst.slotInFile);
         ASSERT(slot < lengthof(env.varArrayMap));
         // and mark "dirty" by chaning from nonzero
-        env.varArrayMap[slot][comp] = { valueId, typeId };
+        env.SetScalar(slot, comp, valueId, typeId);
     }
     else {
         ASSERT(0); // TODO: tgsm, and other outputs for non-CS
@@ -410,9 +685,181 @@ struct ValueAndType {
     SpvId valueId, typeId;
 };
 
+// The static type of the vectors of a group, or the scalar one for a single component:
+static SpvId
+GroupTypeId(uint group, SpvId scalarTypeId)
+{
+    ASSERT(group && !(scalarTypeId & 3u));
+    return scalarTypeId + popcnt(group) - 1u;
+}
+
+// Writes the components of the value of a group into env, each a lane of valueId for more than one:
+static void
+WriteVariableGroup(VariableEnv& env, uint group, const DxbcOperand& dst, SpvId valueId, SpvId scalarTypeId)
+{
+    uint const width = popcnt(group);
+    if (width == 1u) {
+        WriteVariable(env, bsf(group), dst, valueId, scalarTypeId);
+        return;
+    }
+    ASSERT(dst.file == DxbcFile::temp); // TODO: tgsm, and other outputs for non-CS
+    uint const slot = uint(dst.slotInFile);
+    ASSERT(slot < lengthof(env.varArrayMap));
+    uint lane = 0;
+    do {
+        uint const comp = bsf(group);
+        env.varArrayMap[slot][comp] = { valueId, scalarTypeId };
+        env.vectorLanes[slot][comp] = PackVectorLane(lane++, width);
+    } while ((group &= group - 1) != 0);
+}
+
+// The value of a group of components, see NextComponentGroup:
+struct GroupResult {
+    uint group;
+    SpvId valueId, scalarTypeId;
+};
+
+// After all the srcs are read, dst can be one of them:
+static void
+WriteGroupResults(VariableEnv& env, const DxbcOperand& dst, const GroupResult *results, uint numResults)
+{
+    for (uint i = 0; i < numResults; ++i) {
+        WriteVariableGroup(env, results[i].group, dst, results[i].valueId, results[i].scalarTypeId);
+    }
+}
+
+/*
+    The scalar value of a temp component, lanes of a vector value are extracted where they're read.
+    {0, 0} for a component not written yet.
+**/
+static ValueAndType
+ReadComponent(Module& m, SpirvDynamicArray& code, const VariableEnv& env, uint slot, uint comp)
+{
+    PackedValueAndType const var = env.varArrayMap[slot][comp];
+    uint8_t const packedLane = env.vectorLanes[slot][comp];
+    if (!packedLane) {
+        return { var.spvValueId, var.spvStaticTypeId };
+    }
+    SpvId const valueId = EmitCompositeExtract(m, code, var.spvStaticTypeId, var.spvValueId, VectorLaneIndex(packedLane));
+    return { valueId, var.spvStaticTypeId };
+}
+
+static uint32_t
+ImmediateComponent(const Module& m, uint writeMaskComp, const DxbcOperand& src)
+{
+    ASSERT(src.file == DxbcFile::immediate);
+    return m.dxbcImmediates[src.slotInFile].u[src.srcSwizzle[writeMaskComp]];
+}
+
+// A constant of the type of a group (scalar or vector), bits has one entry per component of the group:
+static SpvId
+GetGroupConstantId(Module& m, uint group, SpvId scalarTypeId, const uint32_t *bits)
+{
+    uint32_t componentBits[4];
+    for (uint i = 0; i < popcnt(group); ++i) {
+        componentBits[i] = scalarTypeId == StaticSpvId_TypeBool ? uint32_t(bits[i] != 0) : bits[i];
+    }
+    return m.GetConstantId(GroupTypeId(group, scalarTypeId), componentBits);
+}
+
+// The components of src for a group, when they are all lanes of one vector value:
+struct GroupLanes {
+    SpvId vectorId; // 0 for vThreadID, that's Module::Get_vThreadID_id
+    SpvId scalarTypeId;
+    uint width; // of the vector
+    uint lanes[4];
+
+    bool IsWholeVector(uint groupWidth) const
+    {
+        bool identity = width == groupWidth;
+        for (uint i = 0; i < groupWidth; ++i) {
+            identity = identity && lanes[i] == i;
+        }
+        return identity;
+    }
+};
+
+static bool
+GetGroupLanes(const VariableEnv& env, uint group, const DxbcOperand& src, GroupLanes *pOut)
+{
+    uint i = 0;
+    if (src.file == DxbcFile::vThreadID) {
+        *pOut = { 0, StaticSpvId_TypeGenInt32, 3, {} };
+        for (uint g = group; g; g &= g - 1) {
+            pOut->lanes[i++] = src.srcSwizzle[bsf(g)];
+        }
+        return true;
+    }
+    if (src.file != DxbcFile::temp) {
+        return false;
+    }
+    const PackedValueAndType *const vars = env.varArrayMap[src.slotInFile];
+    const uint8_t *const packedLanes = env.vectorLanes[src.slotInFile];
+    for (uint g = group; g; g &= g - 1) {
+        uint const comp = src.srcSwizzle[bsf(g)];
+        if (!packedLanes[comp] || (i && vars[comp].spvValueId != pOut->vectorId)) {
+            return false;
+        }
+        if (!i) {
+            *pOut = { vars[comp].spvValueId, vars[comp].spvStaticTypeId, VectorLaneWidth(packedLanes[comp]), {} };
+        }
+        pOut->lanes[i++] = VectorLaneIndex(packedLanes[comp]);
+    }
+    return true;
+}
+
+/*
+    Vectorized emission: the components of a writemask that take the same op on the same types can be
+    lowered as one instruction on a vector of that many components. Returns the next group of components
+    (a writemask) to lower, and takes it out of mask.
+
+    That's all of mask if it comes out as fewer words of SPIR-V than numInstrs instructions per component,
+    going by what the srcs are: srcs that are already vectors are free or one OpVectorShuffle, others take
+    an OpCompositeConstruct, and lanes read as scalars an OpCompositeExtract each. Which lanes of the result
+    get read as scalars later isn't known here, each is guessed at 2 words. Otherwise a single component,
+    and the rest of mask is looked at again. Define DXBC_CODEGEN_SCALAR to always get a single component.
+**/
+static uint
+NextComponentGroup(const VariableEnv& env, uint& mask, const DxbcOperand *srcs, uint numSrcs, uint numInstrs = 1)
+{
+    ASSERT(mask);
+    uint group = mask & (0u - mask);
+#ifndef DXBC_CODEGEN_SCALAR
+    uint const width = popcnt(mask);
+    if (width > 1u) {
+        uint scalarWords = 5u * numInstrs * width; // an instruction with 2 operands is 5 words
+        uint vectorWords = 5u * numInstrs + 2u * width; // some of the result lanes will be extracted
+        for (uint i = 0; i < numSrcs; ++i) {
+            const DxbcOperand& src = srcs[i];
+            if (src.file == DxbcFile::immediate) {
+                vectorWords += 3u + width; // OpConstantComposite, unless another one is the same
+                continue;
+            }
+            uint numLaneReads = 0;
+            for (uint g = mask; g && src.file == DxbcFile::temp; g &= g - 1) {
+                numLaneReads += env.vectorLanes[src.slotInFile][src.srcSwizzle[bsf(g)]] != 0;
+            }
+            scalarWords += 5u * numLaneReads;
+            GroupLanes lanes;
+            if (GetGroupLanes(env, mask, src, &lanes)) {
+                vectorWords += lanes.IsWholeVector(width) ? 0u : 5u + width;
+            }
+            else {
+                vectorWords += 3u + width + 5u * numLaneReads;
+            }
+        }
+        if (vectorWords < scalarWords) {
+            group = mask;
+        }
+    }
+#endif
+    mask &= ~group;
+    return group;
+}
+
 static ValueAndType
 GetCurrentValueNoAbsNeg(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
-    uint writeMaskComp, const DxbcOperand& src, SpvId immediateTypeId = StaticSpvId_TypeGenInt32) // hmm, sometimes float would be preferred.
+    uint writeMaskComp, const DxbcOperand& src, SpvId immediateTypeId = StaticSpvId_TypeGenInt32) // what an immediate is read as, up to the consumer
 {
     ASSERT(immediateTypeId < (uint)StaticSpvId_End);
 
@@ -422,10 +869,21 @@ GetCurrentValueNoAbsNeg(Module& m, Function& function, SpirvDynamicArray& code,
     SpvId typeId;
 
     if (src.file == DxbcFile::temp) {
-        PackedValueAndType var = env.varArrayMap[src.slotInFile][srcComponentIndex];
-        ASSERT(var.spvValueId);
-        valueId = var.spvValueId;
-        typeId = var.spvStaticTypeId;
+        ValueAndType const var = ReadComponent(m, code, env, src.slotInFile, srcComponentIndex);
+        if (var.valueId) {
+            valueId = var.valueId;
+            typeId = var.typeId;
+        }
+        else {
+            // Not written on this path, like only in the other arm of an if, same 0 as at a merge.
+            // Also what a lost write in varArrayMap looks like, so not quietly in debug builds:
+#ifndef NDEBUG
+            fprintf(stderr, "warning: r%u.%c is read before it's written, reading 0\n",
+                    src.slotInFile, "xyzw"[srcComponentIndex]);
+#endif
+            valueId = m.GetGIntConstantId(0);
+            typeId = StaticSpvId_TypeGenInt32;
+        }
     }
     else if (src.file == DxbcFile::vThreadID) {
         valueId = m.Get_vThreadID_c_id(&function, srcComponentIndex);
@@ -436,75 +894,176 @@ GetCurrentValueNoAbsNeg(Module& m, Function& function, SpirvDynamicArray& code,
         typeId = StaticSpvId_TypeGenInt32;
     }
     else {
+        // immediates are just bits, the consumer decides what they are:
         ASSERT(src.file == DxbcFile::immediate);
-        if (immediateTypeId == StaticSpvId_TypeGenInt32) {
-            valueId = m.GetGIntConstantId(src.immediateValue.u[srcComponentIndex]);
-            typeId = StaticSpvId_TypeGenInt32;
-        }
-        else {
-            ASSERT(0); // TODO: flt constants
-            return {};
-        }
+        uint32_t const bits = ImmediateComponent(m, writeMaskComp, src);
+        valueId = m.GetScalarConstantId(immediateTypeId, immediateTypeId == StaticSpvId_TypeBool ? uint32_t(bits != 0) : bits);
+        typeId = immediateTypeId;
     }
 
     return { valueId, typeId };
 }
 
-
+// The static type of a src component without emitting anything, what GetCurrentValueNoAbsNeg gives by default:
 static SpvId
-GetSrcValueWithType(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
-                    uint writeMaskComp, const DxbcOperand& src, SpvId desiredTypeId)
+CurrentTypeId(const VariableEnv& env, uint writeMaskComp, const DxbcOperand& src)
 {
-    ValueAndType const current = GetCurrentValueNoAbsNeg(m, function, code, env, writeMaskComp, src, desiredTypeId);
-    SpvId typeId = current.typeId;
-    SpvId valueId = current.valueId;
+    if (src.file == DxbcFile::temp) {
+        PackedValueAndType const var = env.varArrayMap[src.slotInFile][src.srcSwizzle[writeMaskComp]];
+        return var.spvValueId ? SpvId(var.spvStaticTypeId) : SpvId(StaticSpvId_TypeGenInt32);
+    }
+    return StaticSpvId_TypeGenInt32;
+}
+
 
+/*
+    Emits the conversion of a value to another of the static types, bool <-> int is a select/compare, others a bitcast.
+    Vectors convert the same way, component-wise, typeId and desiredTypeId have the same number of components.
+**/
+static SpvId
+ConvertValue(Module& m, SpirvDynamicArray& code, SpvId valueId, SpvId typeId, SpvId desiredTypeId)
+{
     if (typeId != desiredTypeId) {
-        if (typeId == StaticSpvId_TypeBool) {
-            if (desiredTypeId == StaticSpvId_TypeGenInt32) {
-                SpvId a = m.GetGIntConstantId(uint32_t(-1));
-                SpvId b = m.GetGIntConstantId(0);
+        ASSERT((typeId & 3u) == (desiredTypeId & 3u));
+        SpvId const intTypeId = StaticSpvId_TypeGenInt32 + (typeId & 3u);
+        SpvId const boolTypeId = StaticSpvId_TypeBool + (typeId & 3u);
+        if (typeId == boolTypeId) {
+            SpvId a = m.GetSplatConstantId(intTypeId, uint32_t(-1));
+            SpvId b = m.GetSplatConstantId(intTypeId, 0);
+            if (desiredTypeId == intTypeId) {
                 valueId = EmitSelect(m, code, desiredTypeId, valueId, a, b);
             }
             else {
-                ASSERT(desiredTypeId == StaticSpvId_TypeFloat32);
-                ASSERT(0); // TODO
+                // the bits of the int, ~0 or 0
+                ASSERT(desiredTypeId == StaticSpvId_TypeFloat32 + (typeId & 3u));
+                valueId = EmitSelect(m, code, intTypeId, valueId, a, b);
+                valueId = EmitBitcast(m, code, desiredTypeId, valueId);
             }
         }
-        else if (desiredTypeId == StaticSpvId_TypeBool) {
+        else if (desiredTypeId == boolTypeId) {
             // can get here from movc
-            if (typeId == StaticSpvId_TypeGenInt32) {
-                valueId = EmitBinOp(m, code, SpvOpINotEqual, StaticSpvId_TypeBool,
-                    valueId, m.GetGIntConstantId(0));
+            if (typeId == intTypeId) {
+                valueId = EmitBinOp(m, code, SpvOpINotEqual, desiredTypeId,
+                    valueId, m.GetSplatConstantId(intTypeId, 0));
             }
             else {
-                ASSERT(typeId == StaticSpvId_TypeFloat32);
-                ASSERT(0); // TODO
+                // conditions test all the bits, so -0.0 is true
+                ASSERT(typeId == StaticSpvId_TypeFloat32 + (typeId & 3u));
+                valueId = EmitBitcast(m, code, intTypeId, valueId);
+                valueId = EmitBinOp(m, code, SpvOpINotEqual, desiredTypeId,
+                    valueId, m.GetSplatConstantId(intTypeId, 0));
             }
         }
         else {
             valueId = EmitBitcast(m, code, desiredTypeId, valueId);
         }
     }
+    return valueId;
+}
 
+// The abs/neg of a src operand, on its value already converted to typeId (scalar or vector):
+static SpvId
+ApplySrcModifiers(Module& m, SpirvDynamicArray& code, const DxbcOperand& src, SpvId valueId, SpvId typeId)
+{
+    SpvId const scalarTypeId = typeId & ~3u;
+    SpvId constantTypeId;
+    uint32_t bits[4];
+    if ((src.flags & (DxbcOperandFlag_SrcAbs | DxbcOperandFlag_SrcNeg)) && m.GetConstantBits(valueId, &constantTypeId, bits)) {
+        // these are exact, fold them into the constant:
+        for (uint i = 0; i <= (typeId & 3u); ++i) {
+            if (src.flags & DxbcOperandFlag_SrcAbs) {
+                bits[i] &= 0x7FFFFFFFu;
+            }
+            if (src.flags & DxbcOperandFlag_SrcNeg) {
+                bits[i] = scalarTypeId == StaticSpvId_TypeFloat32 ? bits[i] ^ 0x80000000u : 0u - bits[i];
+            }
+        }
+        return m.GetConstantId(typeId, bits);
+    }
     if (src.flags & DxbcOperandFlag_SrcAbs) {
-        ASSERT(desiredTypeId == StaticSpvId_TypeFloat32);
+        ASSERT(scalarTypeId == StaticSpvId_TypeFloat32);
         SpvId const srcValId = valueId;
         valueId = m.AllocId();
         /* 6 words for { dst = unary src... } */
-        code.push_initlist({ SpvOpExtInst | 6 << 16, desiredTypeId, valueId, StaticSpvId_ExtInst_GLSL_std, GLSLstd450FAbs, srcValId });
+        code.push_initlist({ SpvOpExtInst | 6 << 16, typeId, valueId, StaticSpvId_ExtInst_GLSL_std, GLSLstd450FAbs, srcValId });
     }
     if (src.flags & DxbcOperandFlag_SrcNeg) {
-        ASSERT(desiredTypeId == StaticSpvId_TypeFloat32 || desiredTypeId == StaticSpvId_TypeGenInt32);
-        SpvOp const negOp = (desiredTypeId == StaticSpvId_TypeFloat32) ? SpvOpFNegate : SpvOpSNegate;
+        ASSERT(scalarTypeId == StaticSpvId_TypeFloat32 || scalarTypeId == StaticSpvId_TypeGenInt32);
+        SpvOp const negOp = (scalarTypeId == StaticSpvId_TypeFloat32) ? SpvOpFNegate : SpvOpSNegate;
         SpvId const srcValId = valueId;
         valueId = m.AllocId();
-        code.push4(negOp | 4 << 16u, desiredTypeId, valueId, srcValId);
+        code.push4(negOp | 4 << 16u, typeId, valueId, srcValId);
     }
-
     return valueId;
 }
 
+static SpvId
+GetSrcValueWithType(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+                    uint writeMaskComp, const DxbcOperand& src, SpvId desiredTypeId)
+{
+    ValueAndType const current = GetCurrentValueNoAbsNeg(m, function, code, env, writeMaskComp, src, desiredTypeId);
+    SpvId const valueId = ConvertValue(m, code, current.valueId, current.typeId, desiredTypeId);
+    return ApplySrcModifiers(m, code, src, valueId, desiredTypeId);
+}
+
+/*
+    GetSrcValueWithType for the components of a group, as a vector of scalarTypeId: a composite constant
+    for an immediate, the vector value itself (or an OpVectorShuffle of it) if they are all lanes of
+    the same one, otherwise an OpCompositeConstruct of the scalars.
+**/
+static SpvId
+GetSrcGroupWithType(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+                    uint group, const DxbcOperand& src, SpvId scalarTypeId)
+{
+    uint const width = popcnt(group);
+    if (width == 1u) {
+        return GetSrcValueWithType(m, function, code, env, bsf(group), src, scalarTypeId);
+    }
+    SpvId const typeId = GroupTypeId(group, scalarTypeId);
+
+    if (src.file == DxbcFile::immediate) {
+        uint32_t bits[4];
+        uint i = 0;
+        for (uint g = group; g; g &= g - 1) {
+            bits[i++] = ImmediateComponent(m, bsf(g), src);
+        }
+        return ApplySrcModifiers(m, code, src, GetGroupConstantId(m, group, scalarTypeId, bits), typeId);
+    }
+
+    SpvId valueId;
+    GroupLanes lanes;
+    if (GetGroupLanes(env, group, src, &lanes)) {
+        SpvId const vectorId = lanes.vectorId ? lanes.vectorId : m.Get_vThreadID_id(&function);
+        valueId = vectorId;
+        if (!lanes.IsWholeVector(width)) {
+            valueId = m.AllocId();
+            uint32_t *p = code.uninitialized_push_n(5 + width);
+            p[0] = SpvOpVectorShuffle | (5 + width) << 16;
+            p[1] = lanes.scalarTypeId + width - 1u;
+            p[2] = valueId;
+            p[3] = vectorId;
+            p[4] = vectorId;
+            memcpy(p + 5, lanes.lanes, width * sizeof(uint32_t));
+        }
+        valueId = ConvertValue(m, code, valueId, lanes.scalarTypeId + width - 1u, typeId);
+    }
+    else {
+        SpvId componentIds[4];
+        uint i = 0;
+        for (uint g = group; g; g &= g - 1) {
+            ValueAndType const current = GetCurrentValueNoAbsNeg(m, function, code, env, bsf(g), src, scalarTypeId);
+            componentIds[i++] = ConvertValue(m, code, current.valueId, current.typeId, scalarTypeId);
+        }
+        valueId = m.AllocId();
+        uint32_t *p = code.uninitialized_push_n(3 + width);
+        p[0] = SpvOpCompositeConstruct | (3 + width) << 16;
+        p[1] = typeId;
+        p[2] = valueId;
+        memcpy(p + 3, componentIds, width * sizeof(SpvId));
+    }
+    return ApplySrcModifiers(m, code, src, valueId, typeId);
+}
+
 
 static bool
 IsCurrentTypeBool(const VariableEnv& lvn, uint writeCompIndex, const DxbcOperand& src)
@@ -513,278 +1072,963 @@ IsCurrentTypeBool(const VariableEnv& lvn, uint writeCompIndex, const DxbcOperand
 }
 
 /*
-    Recursive codegen dxbc->spirv until { EOF/EndFunction, else, endif, endloop }.
-    Returns said DXBC instruction, XXX: may want the instr before that, like if was ret or break
+    Lowering of one DXBC instruction each, LowerTable has the one for every DxbcInstrTag.
+    Returns the instruction to go on with, or nullptr if Codegen should stop and return this one.
 **/
-static void
-Codegen(Module& m, Function& function, SpirvDynamicArray& code,
-        DxbcTextScanner *scanner, DxbcInstruction& dxbcInstr)
+typedef const DxbcInstruction *LowerFn(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+                                       const DxbcInstruction *pInstr, const DxbcInstruction *pEnd);
+
+static const DxbcInstruction *
+LowerRet(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+         const DxbcInstruction *pInstr, const DxbcInstruction *pEnd)
 {
-    VariableEnv env;
+    code.push(SpvOpReturn | 1u << 16);
+    return nullptr;
+}
 
-    while (!DxbcText_ScanIsEof(scanner)) {    
-        DxbcTextScanResult scanResult = DxbcText_ScanInstrInFuncBody(scanner, &dxbcInstr);
-        if (scanResult != DxbcTextScanResult::Okay) {
-            puts("bad dxbc text :(");
-            return;
-        }
+static const DxbcInstruction *
+Codegen(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+        const DxbcInstruction *pInstr, const DxbcInstruction *pEnd);
 
-        const SpirvOpInfo spvOpInfo = GetSpirvOpInfo(dxbcInstr.tag);
+// One side of an if, the else side of one without an else is the header block itself:
+struct IfArm {
+    BasicBlock block;
+    SpvId lastBlockId = 0; // predecessor of the merge block, not block.spvId if there's a nested if
+    bool terminated = false; // ended in ret/break/continue, so doesn't go to the merge block
+};
 
-        if (dxbcInstr.tag == DxbcInstrTag::ret) {
-            code.push(SpvOpReturn | 1u << 16);
+/*
+    Skips what comes after a ret/break/continue, up to the else/endif/endloop that ends the arm or
+    loop body it was in, none of it is reachable.
+**/
+static const DxbcInstruction *
+SkipUnreachable(const DxbcInstruction *pInstr, const DxbcInstruction *pEnd)
+{
+    uint depth = 0;
+    for (; pInstr != pEnd; ++pInstr) {
+        switch (pInstr->tag) {
+        case DxbcInstrTag::if_:
+        case DxbcInstrTag::loop:
+            depth++;
+            break;
+        case DxbcInstrTag::endif:
+        case DxbcInstrTag::endloop:
+            if (depth == 0) {
+                return pInstr;
+            }
+            depth--;
+            break;
+        case DxbcInstrTag::_else:
+            if (depth == 0) {
+                return pInstr;
+            }
+            break;
+        default:
             break;
         }
-        else if (dxbcInstr.tag == DxbcInstrTag::if_) {
-            printf("got if, nz? %d, fullSrcComp=%c\n", dxbcInstr.flags & DxbcInstrFlag_nz, "xyzw"[dxbcInstr.operands[0].srcSwizzle[0]]);
-        }
-        else if (dxbcInstr.tag == DxbcInstrTag::_else) {
-            puts("got _else, but should handle this on revusrive return form if_");
-        }
-        else if (dxbcInstr.tag == DxbcInstrTag::endif) {
-            puts("got endif");
-        }
-        else if (dxbcInstr.tag == DxbcInstrTag::mov) {
-            uint const writeMask = dxbcInstr.operands[0].dstWritemask;
-            for (uint writeCompIndex = 0; writeCompIndex < 4u; ++writeCompIndex) {
-                if (!(writeMask & 1u << writeCompIndex)) {
+    }
+    return pInstr;
+}
+
+// Codegen stopped at one of these, the block it was emitting into already has its branch/return:
+static bool
+EndsBlock(const DxbcInstruction *pStop, const DxbcInstruction *pEnd)
+{
+    return pStop != pEnd &&
+        (pStop->tag == DxbcInstrTag::ret || pStop->tag == DxbcInstrTag::break_ || pStop->tag == DxbcInstrTag::continue_);
+}
+
+static const DxbcInstruction *
+CodegenIfArm(Module& m, Function& function, IfArm& arm, VariableEnv& env,
+             const DxbcInstruction *pInstr, const DxbcInstruction *pEnd)
+{
+    arm.block.spvId = m.AllocId();
+    function.currentBlockId = arm.block.spvId;
+    const DxbcInstruction *pStop = Codegen(m, function, arm.block.code, env, pInstr, pEnd);
+    arm.lastBlockId = function.currentBlockId;
+    if (EndsBlock(pStop, pEnd)) {
+        arm.terminated = true;
+        pStop = SkipUnreachable(pStop + 1, pEnd);
+    }
+    return pStop;
+}
+
+static void
+EmitIfArm(SpirvDynamicArray& code, const IfArm& arm, SpvId mergeBlockId)
+{
+    code.push2(SpvOpLabel | 2u << 16, arm.block.spvId);
+    code.push_n(arm.block.code.data(), arm.block.code.size());
+    if (!arm.terminated) {
+        code.push2(SpvOpBranch | 2u << 16, mergeBlockId);
+    }
+}
+
+/*
+    if_z/if_nz ... [else ...] endif, as a selection construct. The env is snapshotted when going into the if
+    and at the end of the if arm, and the temp components that differ from the env at the end of the
+    else arm become OpPhi in the merge block, so the values stay SSA ids instead of Function variables.
+
+    The arms are lowered into their own code arrays first, since a phi of two different types needs
+    a conversion in one of the predecessors, before the branch to the merge block.
+**/
+static const DxbcInstruction *
+LowerIf(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+        const DxbcInstruction *pInstr, const DxbcInstruction *pEnd)
+{
+    SpvId const condId = GetSrcValueWithType(m, function, code, env, 0, pInstr->operands[0], StaticSpvId_TypeBool);
+    SpvId const headerBlockId = function.currentBlockId;
+    SpvId const mergeBlockId = m.AllocId();
+    bool const nz = (pInstr->flags & DxbcInstrFlag_nz) != 0;
+
+    std::unique_ptr<VariableEnv> const envBefore(new VariableEnv(env));
+    IfArm arms[2];
+    const DxbcInstruction *pStop = CodegenIfArm(m, function, arms[0], env, pInstr + 1, pEnd);
+    std::unique_ptr<VariableEnv> const envIfArm(new VariableEnv(env));
+    env = *envBefore;
+    bool const hasElse = pStop != pEnd && pStop->tag == DxbcInstrTag::_else;
+    if (hasElse) {
+        pStop = CodegenIfArm(m, function, arms[1], env, pStop + 1, pEnd);
+    }
+    else {
+        arms[1].lastBlockId = headerBlockId;
+    }
+    ASSERT(pStop != pEnd && pStop->tag == DxbcInstrTag::endif); // DxbcControlFlowCheck when scanning
+
+    /*
+        Merge the envs of the arms that get to the merge block, env is the else arm's (or the one from
+        before the if) and becomes the merged one. Conversions for the else side of an if without an else
+        go into the header block, before the OpSelectionMerge.
+    **/
+    struct Phi {
+        SpvId valueId, typeId, incoming[2];
+    };
+    Array<Phi> phis;
+    SpirvDynamicArray& elseCode = hasElse ? arms[1].block.code : code;
+    if (arms[0].terminated && !arms[1].terminated) {
+        // env is already the else arm's
+    }
+    else if (arms[1].terminated) {
+        env = arms[0].terminated ? *envBefore : *envIfArm;
+    }
+    else {
+        uint const numTemps = Min<uint>(m.dxbcHeaderInfo.numTemps, lengthof(env.varArrayMap));
+        for (uint slot = 0; slot < numTemps; ++slot) {
+            for (uint comp = 0; comp < 4u; ++comp) {
+                if (envIfArm->varArrayMap[slot][comp].spvValueId == env.varArrayMap[slot][comp].spvValueId &&
+                    envIfArm->vectorLanes[slot][comp] == env.vectorLanes[slot][comp]) {
                     continue;
                 }
-                ValueAndType const src = GetCurrentValueNoAbsNeg(m, function, code, env, writeCompIndex, dxbcInstr.operands[1]);
-                WriteVariable(env, writeCompIndex, dxbcInstr.operands[0], src.valueId, src.typeId);
+                // lanes of vectors are extracted at the end of the predecessor, the phis are of scalars:
+                ValueAndType const a = ReadComponent(m, arms[0].block.code, *envIfArm, slot, comp);
+                ValueAndType const b = ReadComponent(m, elseCode, env, slot, comp);
+                // Different types, or a side that hasn't written the component yet (which reads as 0), merge as int:
+                SpvId const typeId = (a.typeId == b.typeId && a.valueId && b.valueId)
+                    ? a.typeId : SpvId(StaticSpvId_TypeGenInt32);
+                Phi phi;
+                phi.valueId = m.AllocId();
+                phi.typeId = typeId;
+                phi.incoming[0] = a.valueId
+                    ? ConvertValue(m, arms[0].block.code, a.valueId, a.typeId, typeId) : m.GetGIntConstantId(0);
+                phi.incoming[1] = b.valueId
+                    ? ConvertValue(m, elseCode, b.valueId, b.typeId, typeId) : m.GetGIntConstantId(0);
+                phis.push(phi);
+                env.SetScalar(slot, comp, phi.valueId, typeId);
             }
         }
-        else if (dxbcInstr.tag == DxbcInstrTag::store_uav_typed) {
-            puts("TODO: store_uav_typed without assuming RWBuffer<uint>:register(u0)");
-            SpvId imageId = m.AllocId();
-            code.push4(SpvOpLoad | 4 << 16, m.uav_image_type_ids[0], imageId, m.ptr_uav_ids[0]);
-            SpvId coordId = GetSrcValueWithType(m, function, code, env,
-                0, dxbcInstr.operands[1], StaticSpvId_TypeGenInt32);
-            uint const imageSampledTypeId = StaticSpvId_TypeGenInt32; // XXX, could be float
-            SpvId texelValueId = GetSrcValueWithType(m, function, code, env,
-                0, dxbcInstr.operands[2], imageSampledTypeId);
-            // XXX: write whole swizzled 4-comp value:
-            code.push4(SpvOpImageWrite | 4 << 16, imageId, coordId, texelValueId);
-        }
-        else if (dxbcInstr.tag == DxbcInstrTag::ld_uav_typed) {
-            puts("TODO: ld_uav_typed");
-            const uint numDests = 1;
-            const uint numSrcs = 2; // coord, uav
-            const DxbcOperand *srcs = dxbcInstr.operands + numDests;
-            const DxbcOperand& dst = dxbcInstr.operands[0];
-            const uint writeMask = dst.dstWritemask;
-            ASSERT(writeMask);
-            const uint base = ++m.debugLoadTypedValueBase * 1000;
-            for (uint writeCompIndex = 0; writeCompIndex < 4u; ++writeCompIndex) {
-                if (!(writeMask & 1u << writeCompIndex)) {
-                    continue;
+    }
+
+    SpvId const ifTargetId = arms[0].block.spvId;
+    SpvId const elseTargetId = hasElse ? arms[1].block.spvId : mergeBlockId;
+    code.push3(SpvOpSelectionMerge | 3u << 16, mergeBlockId, SpvSelectionControlMaskNone);
+    code.push4(SpvOpBranchConditional | 4u << 16, condId, nz ? ifTargetId : elseTargetId, nz ? elseTargetId : ifTargetId);
+    EmitIfArm(code, arms[0], mergeBlockId);
+    if (hasElse) {
+        EmitIfArm(code, arms[1], mergeBlockId);
+    }
+
+    m.valueNumbers.Forget(); // the arms' code arrays
+    code.push2(SpvOpLabel | 2u << 16, mergeBlockId);
+    for (const Phi& phi : phis) {
+        code.push_initlist({ SpvOpPhi | 7u << 16, phi.typeId, phi.valueId,
+                             phi.incoming[0], arms[0].lastBlockId, phi.incoming[1], arms[1].lastBlockId });
+    }
+    function.currentBlockId = mergeBlockId;
+    return pStop + 1;
+}
+
+// else and endif end the arm being lowered, LowerIf goes on from them:
+static const DxbcInstruction *
+LowerElse(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+          const DxbcInstruction *pInstr, const DxbcInstruction *pEnd)
+{
+    return nullptr;
+}
+
+static const DxbcInstruction *
+LowerEndIf(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+           const DxbcInstruction *pInstr, const DxbcInstruction *pEnd)
+{
+    return nullptr;
+}
+
+/*
+    loop ... endloop, as a structured loop:
+
+        preheader: OpBranch header
+        header:    OpPhi per temp component written in the body, OpLoopMerge merge continue, OpBranch body
+        body:      break is OpBranch merge, continue (and the end of the body) OpBranch continue
+        continue:  OpPhi of the continue edges, OpBranch header
+        merge:     OpPhi of the break edges
+
+    The components the body writes come from a pre-scan of the writemasks, so the header phis
+    are there before the body is lowered, and only their back-edge operands are patched after.
+    Every break/continue converts its values to the types of the header phis before branching.
+**/
+struct LoopContext {
+    SpvId mergeBlockId = 0;
+    SpvId continueBlockId = 0;
+    Array<uint16_t> vars;       // slot * 4 + component of the temps written in the body
+    Array<uint8_t> varTypeIds;  // static type of each header phi
+    Array<SpvId> headerPhiIds;
+    // vars.size() values per edge, with the block it branches from:
+    Array<SpvId> breakValues, continueValues;
+    Array<SpvId> breakBlockIds, continueBlockIds;
+};
+
+// Or's the temp writemasks of everything up to the endloop of the loop being lowered:
+static void
+ScanLoopBodyWrites(const DxbcInstruction *pInstr, const DxbcInstruction *pEnd, uint8_t (&writeMasks)[256])
+{
+    uint depth = 0;
+    for (; pInstr != pEnd; ++pInstr) {
+        if (pInstr->tag == DxbcInstrTag::loop) {
+            depth++;
+        }
+        else if (pInstr->tag == DxbcInstrTag::endloop) {
+            if (depth == 0) {
+                break;
+            }
+            depth--;
+        }
+        const DxbcOperand& dst = pInstr->operands[0];
+        if (pInstr->numOperands && dst.dstWritemask && dst.file == DxbcFile::temp) {
+            ASSERT(uint(dst.slotInFile) < lengthof(writeMasks));
+            writeMasks[dst.slotInFile] |= dst.dstWritemask;
+        }
+    }
+}
+
+static void
+PushLoopEdge(Module& m, Function& function, SpirvDynamicArray& code, const VariableEnv& env,
+             const LoopContext& loop, Array<SpvId>& values, Array<SpvId>& blockIds)
+{
+    const uint16_t *const vars = loop.vars.data();
+    SpvId *const p = values.uninitialized_push_n(loop.vars.size());
+    for (uint i = 0; i < loop.vars.size(); ++i) {
+        ValueAndType const v = ReadComponent(m, code, env, vars[i] / 4u, vars[i] % 4u);
+        p[i] = ConvertValue(m, code, v.valueId, v.typeId, loop.varTypeIds.data()[i]);
+    }
+    blockIds.push(function.currentBlockId);
+}
+
+/*
+    Right after the label of the continue or merge block, the value of each loop var in it: an OpPhi
+    if the edges into the block don't all have the same one. Without edges the block is unreachable,
+    and the header phis will do.
+**/
+static void
+EmitLoopEdgePhis(Module& m, SpirvDynamicArray& code, const LoopContext& loop,
+                 const Array<SpvId>& values, const Array<SpvId>& blockIds, SpvId *pOut)
+{
+    uint const numVars = loop.vars.size();
+    uint const numEdges = blockIds.size();
+    const SpvId *const edgeValues = values.data();
+    for (uint i = 0; i < numVars; ++i) {
+        SpvId valueId = numEdges ? edgeValues[i] : loop.headerPhiIds.data()[i];
+        for (uint e = 1; e < numEdges; ++e) {
+            if (edgeValues[e * numVars + i] != edgeValues[i]) {
+                valueId = m.AllocId();
+                uint32_t *p = code.uninitialized_push_n(3 + 2 * numEdges);
+                p[0] = SpvOpPhi | (3 + 2 * numEdges) << 16;
+                p[1] = loop.varTypeIds.data()[i];
+                p[2] = valueId;
+                for (uint k = 0; k < numEdges; ++k) {
+                    p[3 + 2 * k] = edgeValues[k * numVars + i];
+                    p[4 + 2 * k] = blockIds.data()[k];
                 }
-                WriteVariable(env, writeCompIndex, dst, m.GetGIntConstantId(base + writeCompIndex), StaticSpvId_TypeGenInt32);
+                break;
             }
         }
-        else if (dxbcInstr.tag == DxbcInstrTag::imad) {
-            const DxbcOperand& dst = dxbcInstr.operands[0];
-            // May modify these, make a copy:
-            DxbcOperand srcs[3]; for (int i = 0; i < 3; ++i) {
-                srcs[i] = dxbcInstr.operands[i + 1];
+        pOut[i] = valueId;
+    }
+}
+
+static const DxbcInstruction *
+LowerLoop(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+          const DxbcInstruction *pInstr, const DxbcInstruction *pEnd)
+{
+    uint8_t writeMasks[256] = {};
+    ScanLoopBodyWrites(pInstr + 1, pEnd, writeMasks);
+
+    LoopContext loop;
+    SpvId const preheaderBlockId = function.currentBlockId;
+    SpvId const headerBlockId = m.AllocId();
+    SpvId const bodyBlockId = m.AllocId();
+    loop.continueBlockId = m.AllocId();
+    loop.mergeBlockId = m.AllocId();
+
+    // The body can write any bits, so a bool (or not yet written) var gets an int phi:
+    Array<SpvId> entryValues;
+    for (uint slot = 0; slot < lengthof(writeMasks); ++slot) {
+        for (uint comp = 0; comp < 4u; ++comp) {
+            if (!(writeMasks[slot] >> comp & 1u)) {
+                continue;
+            }
+            ValueAndType const v = ReadComponent(m, code, env, slot, comp);
+            SpvId const typeId = v.typeId == StaticSpvId_TypeFloat32 ? StaticSpvId_TypeFloat32 : StaticSpvId_TypeGenInt32;
+            loop.vars.push(uint16_t(slot * 4u + comp));
+            loop.varTypeIds.push(uint8_t(typeId));
+            loop.headerPhiIds.push(m.AllocId());
+            entryValues.push(v.valueId ? ConvertValue(m, code, v.valueId, v.typeId, typeId) : m.GetGIntConstantId(0));
+        }
+    }
+    uint const numVars = loop.vars.size();
+
+    code.push2(SpvOpBranch | 2u << 16, headerBlockId);
+    code.push2(SpvOpLabel | 2u << 16, headerBlockId);
+    uint const headerPhisIndex = code.size();
+    for (uint i = 0; i < numVars; ++i) {
+        // the back-edge value is patched in once the continue block is done
+        code.push_initlist({ SpvOpPhi | 7u << 16, loop.varTypeIds[i], loop.headerPhiIds[i],
+                             entryValues[i], preheaderBlockId, 0, loop.continueBlockId });
+        env.SetScalar(loop.vars[i] / 4u, loop.vars[i] % 4u, loop.headerPhiIds[i], loop.varTypeIds[i]);
+    }
+    code.push4(SpvOpLoopMerge | 4u << 16, loop.mergeBlockId, loop.continueBlockId, SpvLoopControlMaskNone);
+    code.push2(SpvOpBranch | 2u << 16, bodyBlockId);
+    code.push2(SpvOpLabel | 2u << 16, bodyBlockId);
+
+    LoopContext *const outerLoop = function.innermostLoop;
+    function.innermostLoop = &loop;
+    function.currentBlockId = bodyBlockId;
+    const DxbcInstruction *pStop = Codegen(m, function, code, env, pInstr + 1, pEnd);
+    if (EndsBlock(pStop, pEnd)) {
+        pStop = SkipUnreachable(pStop + 1, pEnd);
+    }
+    else {
+        // the end of the body continues
+        PushLoopEdge(m, function, code, env, loop, loop.continueValues, loop.continueBlockIds);
+        code.push2(SpvOpBranch | 2u << 16, loop.continueBlockId);
+    }
+    function.innermostLoop = outerLoop;
+    ASSERT(pStop != pEnd && pStop->tag == DxbcInstrTag::endloop); // DxbcControlFlowCheck when scanning
+
+    Array<SpvId> values;
+    SpvId *const backEdgeValues = values.uninitialized_push_n(numVars);
+    code.push2(SpvOpLabel | 2u << 16, loop.continueBlockId);
+    EmitLoopEdgePhis(m, code, loop, loop.continueValues, loop.continueBlockIds, backEdgeValues);
+    code.push2(SpvOpBranch | 2u << 16, headerBlockId);
+    for (uint i = 0; i < numVars; ++i) {
+        code[headerPhisIndex + 7u * i + 5u] = backEdgeValues[i];
+    }
+
+    // Only the loop vars can differ from before the loop, the rest of env is still good:
+    SpvId *const exitValues = values.data();
+    code.push2(SpvOpLabel | 2u << 16, loop.mergeBlockId);
+    EmitLoopEdgePhis(m, code, loop, loop.breakValues, loop.breakBlockIds, exitValues);
+    for (uint i = 0; i < numVars; ++i) {
+        env.SetScalar(loop.vars[i] / 4u, loop.vars[i] % 4u, exitValues[i], loop.varTypeIds[i]);
+    }
+    function.currentBlockId = loop.mergeBlockId;
+    return pStop + 1;
+}
+
+// endloop ends the body being lowered, LowerLoop goes on from it:
+static const DxbcInstruction *
+LowerEndLoop(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+             const DxbcInstruction *pInstr, const DxbcInstruction *pEnd)
+{
+    return nullptr;
+}
+
+static const DxbcInstruction *
+LowerBreak(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+           const DxbcInstruction *pInstr, const DxbcInstruction *pEnd)
+{
+    ASSERT(function.innermostLoop); // DxbcControlFlowCheck when scanning, TODO: break out of a switch
+    LoopContext& loop = *function.innermostLoop;
+    PushLoopEdge(m, function, code, env, loop, loop.breakValues, loop.breakBlockIds);
+    code.push2(SpvOpBranch | 2u << 16, loop.mergeBlockId);
+    return nullptr;
+}
+
+static const DxbcInstruction *
+LowerContinue(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+              const DxbcInstruction *pInstr, const DxbcInstruction *pEnd)
+{
+    ASSERT(function.innermostLoop);
+    LoopContext& loop = *function.innermostLoop;
+    PushLoopEdge(m, function, code, env, loop, loop.continueValues, loop.continueBlockIds);
+    code.push2(SpvOpBranch | 2u << 16, loop.continueBlockId);
+    return nullptr;
+}
+
+/*
+    breakc/continuec: a conditional branch out of the current block, no merge instruction needed since
+    one target is the loop's merge or continue block. Lowering goes on in a new block.
+**/
+static const DxbcInstruction *
+LowerConditionalLoopExit(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+                         const DxbcInstruction *pInstr, bool isBreak)
+{
+    ASSERT(function.innermostLoop);
+    LoopContext& loop = *function.innermostLoop;
+    SpvId const condId = GetSrcValueWithType(m, function, code, env, 0, pInstr->operands[0], StaticSpvId_TypeBool);
+    SpvId const targetId = isBreak ? loop.mergeBlockId : loop.continueBlockId;
+    SpvId const nextBlockId = m.AllocId();
+    bool const nz = (pInstr->flags & DxbcInstrFlag_nz) != 0;
+
+    if (isBreak) {
+        PushLoopEdge(m, function, code, env, loop, loop.breakValues, loop.breakBlockIds);
+    }
+    else {
+        PushLoopEdge(m, function, code, env, loop, loop.continueValues, loop.continueBlockIds);
+    }
+    code.push4(SpvOpBranchConditional | 4u << 16, condId, nz ? targetId : nextBlockId, nz ? nextBlockId : targetId);
+    code.push2(SpvOpLabel | 2u << 16, nextBlockId);
+    function.currentBlockId = nextBlockId;
+    return pInstr + 1;
+}
+
+static const DxbcInstruction *
+LowerBreakC(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+            const DxbcInstruction *pInstr, const DxbcInstruction *pEnd)
+{
+    return LowerConditionalLoopExit(m, function, code, env, pInstr, true);
+}
+
+static const DxbcInstruction *
+LowerContinueC(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+               const DxbcInstruction *pInstr, const DxbcInstruction *pEnd)
+{
+    return LowerConditionalLoopExit(m, function, code, env, pInstr, false);
+}
+
+static const DxbcInstruction *
+LowerMov(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+         const DxbcInstruction *pInstr, const DxbcInstruction *pEnd)
+{
+    const DxbcInstruction& dxbcInstr = *pInstr;
+    const DxbcOperand& dst = dxbcInstr.operands[0];
+    const DxbcOperand& src = dxbcInstr.operands[1];
+    // All of src is read before dst is written, they can be the same register:
+    PackedValueAndType values[4];
+    uint8_t packedLanes[4] = { };
+    uint const writeMask = dst.dstWritemask;
+    ASSERT(writeMask);
+    for (uint wm = writeMask; wm; wm &= wm - 1) {
+        uint const writeCompIndex = bsf(wm);
+        if (src.file == DxbcFile::temp && env.vectorLanes[src.slotInFile][src.srcSwizzle[writeCompIndex]]) {
+            // stays a lane of the same vector, nothing to extract
+            values[writeCompIndex] = env.varArrayMap[src.slotInFile][src.srcSwizzle[writeCompIndex]];
+            packedLanes[writeCompIndex] = env.vectorLanes[src.slotInFile][src.srcSwizzle[writeCompIndex]];
+            continue;
+        }
+        ValueAndType const v = GetCurrentValueNoAbsNeg(m, function, code, env, writeCompIndex, src);
+        values[writeCompIndex] = { v.valueId, v.typeId };
+    }
+    for (uint wm = writeMask; wm; wm &= wm - 1) {
+        uint const writeCompIndex = bsf(wm);
+        WriteVariable(env, writeCompIndex, dst, values[writeCompIndex].spvValueId, values[writeCompIndex].spvStaticTypeId);
+        env.vectorLanes[dst.slotInFile][writeCompIndex] = packedLanes[writeCompIndex];
+    }
+    return pInstr + 1;
+}
+
+static const DxbcInstruction *
+LowerStoreUavTyped(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+                   const DxbcInstruction *pInstr, const DxbcInstruction *pEnd)
+{
+    const DxbcInstruction& dxbcInstr = *pInstr;
+    puts("TODO: store_uav_typed without assuming RWBuffer<uint>:register(u0)");
+    SpvId imageId = m.AllocId();
+    code.push4(SpvOpLoad | 4 << 16, m.uav_image_type_ids[0], imageId, m.ptr_uav_ids[0]);
+    SpvId coordId = GetSrcValueWithType(m, function, code, env,
+        0, dxbcInstr.operands[1], StaticSpvId_TypeGenInt32);
+    uint const imageSampledTypeId = StaticSpvId_TypeGenInt32; // XXX, could be float
+    SpvId texelValueId = GetSrcValueWithType(m, function, code, env,
+        0, dxbcInstr.operands[2], imageSampledTypeId);
+    // XXX: write whole swizzled 4-comp value:
+    code.push4(SpvOpImageWrite | 4 << 16, imageId, coordId, texelValueId);
+    return pInstr + 1;
+}
+
+static const DxbcInstruction *
+LowerLdUavTyped(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+                const DxbcInstruction *pInstr, const DxbcInstruction *pEnd)
+{
+    // TODO: ld_uav_typed, writes numbered debug constants instead of loading
+    const DxbcInstruction& dxbcInstr = *pInstr;
+    const DxbcOperand& dst = dxbcInstr.operands[0];
+    const uint writeMask = dst.dstWritemask;
+    ASSERT(writeMask);
+    const uint base = ++m.debugLoadTypedValueBase * 1000;
+    for (uint writeCompIndex = 0; writeCompIndex < 4u; ++writeCompIndex) {
+        if (!(writeMask & 1u << writeCompIndex)) {
+            continue;
+        }
+        WriteVariable(env, writeCompIndex, dst, m.GetGIntConstantId(base + writeCompIndex), StaticSpvId_TypeGenInt32);
+    }
+    return pInstr + 1;
+}
+
+static const DxbcInstruction *
+LowerImad(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+          const DxbcInstruction *pInstr, const DxbcInstruction *pEnd)
+{
+    const DxbcInstruction& dxbcInstr = *pInstr;
+    const DxbcOperand& dst = dxbcInstr.operands[0];
+    // May modify these, make a copy:
+    DxbcOperand srcs[3]; for (int i = 0; i < 3; ++i) {
+        srcs[i] = dxbcInstr.operands[i + 1];
+    }
+    // -a*-b == a*b
+    if (srcs[0].flags & srcs[1].flags & DxbcOperandFlag_SrcNeg) {
+        srcs[0].flags &= ~DxbcOperandFlag_SrcNeg;
+        srcs[1].flags &= ~DxbcOperandFlag_SrcNeg;
+    }
+    ASSERT(srcs[0].file != DxbcFile::immediate); // TODO: swap src[0], src[1] ?
+    uint shiftMask = 0;
+    DxbcImmediate imm1; // srcs[1] with the negate and power-of-2 multiplies folded in
+    if (srcs[1].file == DxbcFile::immediate) {
+        imm1 = m.dxbcImmediates[srcs[1].slotInFile];
+        if (srcs[1].flags & DxbcOperandFlag_SrcNeg) {
+            srcs[1].flags &= ~DxbcOperandFlag_SrcNeg;
+            for (uint32_t& r : imm1.u) {
+                r = -int32_t(r);
             }
-            // -a*-b == a*b
-            if (srcs[0].flags & srcs[1].flags & DxbcOperandFlag_SrcNeg) {
-                srcs[0].flags &= ~DxbcOperandFlag_SrcNeg;
-                srcs[1].flags &= ~DxbcOperandFlag_SrcNeg;
+        }
+        for (int i = 0; i < 4; ++i) {
+            uint32_t& r = imm1.u[i];
+            if (r && (r & (r - 1)) == 0) {
+                r = bsf(r);
+                shiftMask |= 1u << i;
             }
-            ASSERT(srcs[0].file != DxbcFile::immediate); // TODO: swap src[0], src[1] ?
-            uint shiftMask = 0;
-            if (srcs[1].file == DxbcFile::immediate) {
-                if (srcs[1].flags & DxbcOperandFlag_SrcNeg) {
-                    srcs[1].flags &= ~DxbcOperandFlag_SrcNeg;
-                    for (uint32_t& r : srcs[1].immediateValue.u) {
-                        r = -int32_t(r);
+        }
+    }
+    enum class Plan { MulAdd, MulSub, MulReverseSub } plan = Plan::MulAdd;
+    if (srcs[2].flags & DxbcOperandFlag_SrcNeg) {
+        plan = Plan::MulSub;
+        srcs[2].flags &= ~DxbcOperandFlag_SrcNeg;
+    }
+    else if ((srcs[0].flags | srcs[1].flags) & DxbcOperandFlag_SrcNeg) {
+        ASSERT((srcs[0].flags ^ srcs[1].flags) & DxbcOperandFlag_SrcNeg);
+        plan = Plan::MulReverseSub;
+        // or do the normalize thing before.
+        srcs[0].flags &= ~DxbcOperandFlag_SrcNeg;
+        srcs[1].flags &= ~DxbcOperandFlag_SrcNeg;
+    }
+    uint const writeMask = dst.dstWritemask;
+    ASSERT(writeMask);
+    // A shift by the power-of-2 immediate components, a multiply for the others:
+    uint shiftGroupMask = 0;
+    for (uint wm = writeMask; wm; wm &= wm - 1) {
+        if (shiftMask & 1u << srcs[1].srcSwizzle[bsf(wm)]) {
+            shiftGroupMask |= wm & (0u - wm);
+        }
+    }
+    uint const groupMasks[2] = { writeMask & ~shiftGroupMask, shiftGroupMask };
+    GroupResult results[4];
+    uint numResults = 0;
+    for (uint isShift = 0; isShift < 2u; ++isShift) {
+        SpvOp const mulOp = isShift ? SpvOpShiftLeftLogical : SpvOpIMul;
+        for (uint rest = groupMasks[isShift]; rest; ) {
+            uint const group = NextComponentGroup(env, rest, srcs, 3, 2);
+            SpvId const typeId = GroupTypeId(group, StaticSpvId_TypeGenInt32);
+            SpvId srcValIds[3]; for (int i = 0; i < 3; ++i) {
+                if (i == 1 && srcs[1].file == DxbcFile::immediate) {
+                    uint32_t bits[4];
+                    uint n = 0;
+                    for (uint g = group; g; g &= g - 1) {
+                        bits[n++] = imm1.u[srcs[1].srcSwizzle[bsf(g)]];
                     }
+                    srcValIds[1] = GetGroupConstantId(m, group, StaticSpvId_TypeGenInt32, bits);
+                    continue;
                 }
-                for (int i = 0; i < 4; ++i) {
-                    uint32_t& r = srcs[1].immediateValue.u[i];
-                    if (r && (r & (r - 1)) == 0) {
-                        r = bsf(r);
-                        shiftMask |= 1u << i;
-                    }
+                srcValIds[i] = GetSrcGroupWithType(m, function, code, env, group, srcs[i], StaticSpvId_TypeGenInt32);
+            }
+            SpvId productId = EmitBinOp(m, code, mulOp, typeId, srcValIds[0], srcValIds[1]);
+            SpvOp addOp = SpvOpIAdd;
+            if (plan != Plan::MulAdd) {
+                addOp = SpvOpISub;
+                if (plan == Plan::MulReverseSub) {
+                    Swap(productId, srcValIds[2]);
                 }
             }
-            enum class Plan { MulAdd, MulSub, MulReverseSub } plan = Plan::MulAdd;
-            if (srcs[2].flags & DxbcOperandFlag_SrcNeg) {
-                plan = Plan::MulSub;
-                srcs[2].flags &= ~DxbcOperandFlag_SrcNeg;
+            SpvId finalVal = EmitBinOp(m, code, addOp, typeId, productId, srcValIds[2]);
+            results[numResults++] = { group, finalVal, StaticSpvId_TypeGenInt32 };
+        }
+    }
+    WriteGroupResults(env, dst, results, numResults);
+    return pInstr + 1;
+}
+
+static const DxbcInstruction *
+LowerMovc(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+          const DxbcInstruction *pInstr, const DxbcInstruction *pEnd)
+{
+    const DxbcInstruction& dxbcInstr = *pInstr;
+    const DxbcOperand *srcs = dxbcInstr.operands + 1;
+    const DxbcOperand& dst = dxbcInstr.operands[0];
+    uint const writeMask = dst.dstWritemask;
+    ASSERT(writeMask);
+    // by the type of the two values, bool/int/float. Bool only if both are, an immediate reads as
+    // int so l(31) doesn't become true, then float if either is, the bool side becomes ~0 or 0:
+    uint groupMasks[3] = { };
+    for (uint wm = writeMask; wm; wm &= wm - 1) {
+        SpvId const aTypeId = CurrentTypeId(env, bsf(wm), srcs[1]);
+        SpvId const bTypeId = CurrentTypeId(env, bsf(wm), srcs[2]);
+        SpvId const typeId = aTypeId == bTypeId ? aTypeId
+            : (aTypeId == StaticSpvId_TypeFloat32 || bTypeId == StaticSpvId_TypeFloat32) ? SpvId(StaticSpvId_TypeFloat32)
+            : SpvId(StaticSpvId_TypeGenInt32);
+        groupMasks[(typeId - StaticSpvId_TypeBool) / 4u] |= wm & (0u - wm);
+    }
+    GroupResult results[4];
+    uint numResults = 0;
+    for (uint t = 0; t < 3u; ++t) {
+        SpvId const typeId = StaticSpvId_TypeBool + 4u * t;
+        for (uint rest = groupMasks[t]; rest; ) {
+            uint const group = NextComponentGroup(env, rest, srcs, 3);
+            SpvId srcValueIds[3];
+            srcValueIds[1] = GetSrcGroupWithType(m, function, code, env, group, srcs[1], typeId);
+            srcValueIds[0] = GetSrcGroupWithType(m, function, code, env, group, srcs[0], StaticSpvId_TypeBool);
+            srcValueIds[2] = GetSrcGroupWithType(m, function, code, env, group, srcs[2], typeId);
+            SpvId dstValueId = EmitSelect(m, code, GroupTypeId(group, typeId), srcValueIds[0], srcValueIds[1], srcValueIds[2]);
+            results[numResults++] = { group, dstValueId, typeId };
+        }
+    }
+    WriteGroupResults(env, dst, results, numResults);
+    return pInstr + 1;
+}
+
+// The ops that map to one SPIR-V op per component, see SpirvOpInfo:
+static const DxbcInstruction *
+LowerAluOp(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+           const DxbcInstruction *pInstr, const DxbcInstruction *pEnd)
+{
+    const DxbcInstruction& dxbcInstr = *pInstr;
+    const SpirvOpInfo spvOpInfo = GetSpirvOpInfo(dxbcInstr.tag);
+    const uint numDests = dxbcInstr.NumDstRegs();
+    const DxbcOperand& dst = dxbcInstr.operands[0];
+    ASSERT(numDests == 1);
+    ASSERT(dxbcInstr.NumSrcRegs() == 2); // TODO: handle other stuff
+    const uint writeMask = dst.dstWritemask;
+    ASSERT(writeMask);
+
+    const DxbcOperand *srcs = dxbcInstr.operands + numDests; // can mut for add ans shift stuff
+    DxbcOperand aTmpSrcs[3]; // for add/sub order and flags.
+
+    // ult, ieq can have diff dst type id
+    SpvId srcTypeSpvId = spvOpInfo.IsFloatArithmeticOrCompare() ? StaticSpvId_TypeFloat32 : StaticSpvId_TypeGenInt32;
+    SpvId dstTypeSpvId = spvOpInfo.DstComponentTypeId();
+
+    SpvOp op = SpvOp(spvOpInfo.similarSpvOp);
+
+    /* pre src fetch special handling, the same for each comp: */
+    if (op == SpvOpIAdd || op == SpvOpFAdd) {
+        aTmpSrcs[0] = srcs[0];
+        aTmpSrcs[1] = srcs[1];
+        SpvOp const subOp = (op == SpvOpIAdd) ? SpvOpISub : SpvOpFSub;
+        if (aTmpSrcs[0].flags & DxbcOperandFlag_SrcNeg) {
+            op = subOp;
+            if (aTmpSrcs[1].flags & DxbcOperandFlag_SrcNeg) {
+                // dst = -a + -b :: -a - b
+                aTmpSrcs[1].flags &= ~DxbcOperandFlag_SrcNeg;
             }
-            else if ((srcs[0].flags | srcs[1].flags) & DxbcOperandFlag_SrcNeg) {
-                ASSERT((srcs[0].flags ^ srcs[1].flags) & DxbcOperandFlag_SrcNeg);
-                plan = Plan::MulReverseSub;
-                // or do the normalize thing before.
-                srcs[0].flags &= ~DxbcOperandFlag_SrcNeg;
-                srcs[1].flags &= ~DxbcOperandFlag_SrcNeg;
+            else {
+                // dst = -a + b :: b - a
+                aTmpSrcs[0].flags &= ~DxbcOperandFlag_SrcNeg;
+                DxbcOperand const tmp0 = aTmpSrcs[0]; // swap em
+                aTmpSrcs[0] = aTmpSrcs[1];
+                aTmpSrcs[1] = tmp0;
             }
-            uint wm = dst.dstWritemask;
-            ASSERT(wm);
-            do {
-                uint const writeCompIndex = bsf(wm);
-                SpvOp mulOp = SpvOpIMul;
-                uint fullSrcComp = srcs[1].srcSwizzle[writeCompIndex];
-                if (shiftMask & (1u << fullSrcComp)) {
-                    mulOp = SpvOpShiftLeftLogical;
-                }
-                SpvId srcValIds[3]; for (int i = 0; i < 3; ++i) {
-                    srcValIds[i] = GetSrcValueWithType(m, function, code, env, writeCompIndex, srcs[i], StaticSpvId_TypeGenInt32);
-                }
-                SpvId productId = EmitBinOp(m, code, mulOp, StaticSpvId_TypeGenInt32, srcValIds[0], srcValIds[1]);
-                SpvOp addOp = SpvOpIAdd;
-                if (plan != Plan::MulAdd) {
-                    addOp = SpvOpISub;
-                    if (plan == Plan::MulReverseSub) {
-                        Swap(productId, srcValIds[2]);
-                    }
-                }
-                SpvId finalVal = EmitBinOp(m, code, addOp, StaticSpvId_TypeGenInt32, productId, srcValIds[2]);
-                WriteVariable(env, writeCompIndex, dst, finalVal, StaticSpvId_TypeGenInt32);
-            } while ((wm &= wm - 1) != 0);
-        }
-        else if (dxbcInstr.tag == DxbcInstrTag::movc) {
-            const DxbcOperand *srcs = dxbcInstr.operands + 1;
-            const DxbcOperand& dst = dxbcInstr.operands[0];
-            uint wm = dst.dstWritemask;
-            ASSERT(wm);
-            do {
-                uint const writeCompIndex = bsf(wm);
-                uint const k = (srcs[1].file != DxbcFile::immediate) ? 0 : 1; // src[k + 1] decides the dest type
-                ValueAndType const src_k = GetCurrentValueNoAbsNeg(m, function, code, env, writeCompIndex, srcs[k+1]);
-                SpvId srcValueIds[3];
-                srcValueIds[0] = GetSrcValueWithType(m, function, code, env, writeCompIndex, srcs[0], StaticSpvId_TypeBool);
-                srcValueIds[k+1] = src_k.valueId;
-                uint const otherSrcIndex = (k ^ 1) + 1;
-                srcValueIds[otherSrcIndex] = GetSrcValueWithType(m, function, code, env, writeCompIndex, srcs[otherSrcIndex], src_k.typeId);
-                SpvId dstValueId = EmitSelect(m, code, src_k.typeId, srcValueIds[0], srcValueIds[1], srcValueIds[2]);
-                WriteVariable(env, writeCompIndex, dst, dstValueId, src_k.typeId);
-            } while ((wm &= wm - 1) != 0);
-        } else {
-            const uint numDests = dxbcInstr.NumDstRegs();
-            const uint numSrcs = dxbcInstr.NumSrcRegs();
-            const DxbcOperand& dst = dxbcInstr.operands[0];
-            ASSERT(numDests == 1);
-            ASSERT(numSrcs == 2); // TODO: handle other stuff
-            const uint writeMask = dst.dstWritemask;
-            ASSERT(writeMask);
-            for (uint writeCompIndex = 0; writeCompIndex < 4u; ++writeCompIndex) {
-                if (!(writeMask & 1u << writeCompIndex)) {
-                    continue;
-                }
+            srcs = aTmpSrcs;
+        }
+        else if (aTmpSrcs[1].flags & DxbcOperandFlag_SrcNeg) {
+            // dst =  a + -b :: a - b
+            op = subOp;
+            aTmpSrcs[1].flags &= ~DxbcOperandFlag_SrcNeg;
+            srcs = aTmpSrcs;
+        }
+    }
 
-                const DxbcOperand *srcs = dxbcInstr.operands + numDests; // can mut for add ans shift stuff
-                DxbcOperand aTmpSrcs[3]; // for add/sub order and flags.
-
-                // ult, ieq can have diff dst type id
-                SpvId srcTypeSpvId = spvOpInfo.IsFloatArithmeticOrCompare() ? StaticSpvId_TypeFloat32 : StaticSpvId_TypeGenInt32;
-                SpvId dstTypeSpvId = spvOpInfo.DstComponentTypeId();
-
-                SpvOp op = SpvOp(spvOpInfo.similarSpvOp);
-                SpvId srcValueIds[2];
-
-                /* pre src fetch special handling, some of this is the same for each comp and could be moved up */
-                if (op == SpvOpIAdd || op == SpvOpFAdd) {
-                    aTmpSrcs[0] = srcs[0];
-                    aTmpSrcs[1] = srcs[1];
-                    SpvOp const subOp = (op == SpvOpIAdd) ? SpvOpISub : SpvOpFSub;
-                    if (aTmpSrcs[0].flags & DxbcOperandFlag_SrcNeg) {
-                        op = subOp;
-                        if (aTmpSrcs[1].flags & DxbcOperandFlag_SrcNeg) {
-                            // dst = -a + -b :: -a - b
-                            aTmpSrcs[1].flags &= ~DxbcOperandFlag_SrcNeg;
-                        }
-                        else {
-                            // dst = -a + b :: b - a
-                            aTmpSrcs[0].flags &= ~DxbcOperandFlag_SrcNeg;
-                            DxbcOperand const tmp0 = aTmpSrcs[0]; // swap em
-                            aTmpSrcs[0] = aTmpSrcs[1];
-                            aTmpSrcs[1] = tmp0;
-                        }
-                        srcs = aTmpSrcs;
-                    }
-                    else if (aTmpSrcs[1].flags & DxbcOperandFlag_SrcNeg) {
-                        // dst =  a + -b :: a - b
-                        op = subOp;
-                        aTmpSrcs[1].flags &= ~DxbcOperandFlag_SrcNeg;
-                        srcs = aTmpSrcs;
-                    }
-                }
-                else if (spvOpInfo.IsBitShift()) {
-                    if (srcs[1].file == DxbcFile::immediate) {
-                        aTmpSrcs[0] = srcs[0];
-                        aTmpSrcs[1] = srcs[1];
-                        aTmpSrcs[1].immediateValue.u[aTmpSrcs[1].srcSwizzle[writeCompIndex]] &= 31u;
-                        srcs = aTmpSrcs;
-                    }
-                }
-                else if (const SpvOp boolSpvOp = spvOpInfo.BoolLogicOpOfBitwiseIntOp()) { 
-                    /* Prefer leaving stuff in bools if the next op can be done using bools: */
-                    if (IsCurrentTypeBool(env, writeCompIndex, srcs[0]) && 
-                        IsCurrentTypeBool(env, writeCompIndex, srcs[1])) {
-                        
-                        dstTypeSpvId = StaticSpvId_TypeBool;
-                        srcTypeSpvId = StaticSpvId_TypeBool;
-                        op = boolSpvOp;
-                    }
-                }
+    /* Prefer leaving stuff in bools if the next op can be done using bools, that's per comp: */
+    SpvOp const boolSpvOp = spvOpInfo.BoolLogicOpOfBitwiseIntOp();
+    uint boolGroupMask = 0;
+    if (boolSpvOp) {
+        for (uint wm = writeMask; wm; wm &= wm - 1) {
+            if (IsCurrentTypeBool(env, bsf(wm), srcs[0]) && IsCurrentTypeBool(env, bsf(wm), srcs[1])) {
+                boolGroupMask |= wm & (0u - wm);
+            }
+        }
+    }
 
-                /* fetch srcs: */
-                for (uint srcIndex = 0; srcIndex < numSrcs; ++srcIndex) {
-                    srcValueIds[srcIndex] = GetSrcValueWithType(m, function, code, env, writeCompIndex,
-                                                                srcs[srcIndex], srcTypeSpvId);
+    uint const groupMasks[2] = { writeMask & ~boolGroupMask, boolGroupMask };
+    GroupResult results[4];
+    uint numResults = 0;
+    for (uint isBool = 0; isBool < 2u; ++isBool) {
+        SpvOp const groupOp = isBool ? boolSpvOp : op;
+        SpvId const groupSrcTypeId = isBool ? SpvId(StaticSpvId_TypeBool) : srcTypeSpvId;
+        SpvId const groupDstTypeId = isBool ? SpvId(StaticSpvId_TypeBool) : dstTypeSpvId;
+        for (uint rest = groupMasks[isBool]; rest; ) {
+            uint const group = NextComponentGroup(env, rest, srcs, 2);
+            SpvId srcValueIds[2];
+
+            /* fetch srcs: */
+            srcValueIds[0] = GetSrcGroupWithType(m, function, code, env, group, srcs[0], groupSrcTypeId);
+            if (spvOpInfo.IsBitShift() && srcs[1].file == DxbcFile::immediate) {
+                /* dxbc uses the low 5 bits of the shift, can do that on the constant: */
+                uint32_t bits[4];
+                uint n = 0;
+                for (uint g = group; g; g &= g - 1) {
+                    bits[n++] = ImmediateComponent(m, bsf(g), srcs[1]) & 31u;
                 }
+                srcValueIds[1] = GetGroupConstantId(m, group, StaticSpvId_TypeGenInt32, bits);
+            }
+            else {
+                srcValueIds[1] = GetSrcGroupWithType(m, function, code, env, group, srcs[1], groupSrcTypeId);
+            }
 
-                /* post src fetch special handling: */
-                if (spvOpInfo.IsBitShift() && srcs[1].file != DxbcFile::immediate) {
-                    /* undefined in spirv if shift exceeds bitwidth of type, dxbc says low 5 bits are used (for uint32_t). */
-                    srcValueIds[1] = EmitBinOp(m, code, SpvOpBitwiseAnd, StaticSpvId_TypeGenInt32, srcValueIds[1], m.GetGIntConstantId(31));
-                }
+            /* post src fetch special handling: */
+            if (spvOpInfo.IsBitShift() && srcs[1].file != DxbcFile::immediate) {
+                /* undefined in spirv if shift exceeds bitwidth of type, dxbc says low 5 bits are used (for uint32_t). */
+                SpvId const shiftTypeId = GroupTypeId(group, StaticSpvId_TypeGenInt32);
+                srcValueIds[1] = EmitBinOp(m, code, SpvOpBitwiseAnd, shiftTypeId, srcValueIds[1], m.GetSplatConstantId(shiftTypeId, 31));
+            }
+
+            SpvId dstValueId = EmitBinOp(m, code, groupOp, GroupTypeId(group, groupDstTypeId),
+                                         srcValueIds[0], srcValueIds[1]);
+            results[numResults++] = { group, dstValueId, groupDstTypeId };
+        }
+    }
+    WriteGroupResults(env, dst, results, numResults);
+    return pInstr + 1;
+}
+
+static LowerFn *const LowerTable[] = {
+#define DXBC_INSTR_LOWER_FN(tag, mnemonic, cls, sbOp, spvOp, spvOpClass, lower) Lower##lower,
+    DXBC_INSTRUCTIONS(DXBC_INSTR_LOWER_FN)
+#undef DXBC_INSTR_LOWER_FN
+};
+
+/*
+    Recursive codegen dxbc->spirv until { EOF/EndFunction, else, endif, endloop }, or a ret/break/continue
+    that ends the block. Returns said DXBC instruction (pEnd at the end of the stream).
+**/
+static const DxbcInstruction *
+Codegen(Module& m, Function& function, SpirvDynamicArray& code, VariableEnv& env,
+        const DxbcInstruction *pInstr, const DxbcInstruction *pEnd)
+{
+    while (pInstr != pEnd) {
+        ASSERT(uint(pInstr->tag) < lengthof(LowerTable)); // no declarations in here
+        const DxbcInstruction *const pNext = LowerTable[uint(pInstr->tag)](m, function, code, env, pInstr, pEnd);
+        if (!pNext) {
+            break;
+        }
+        pInstr = pNext;
+    }
+    return pInstr;
+}
+
+// What stays in the body whether its result is used or not, the rest the lowering emits are
+// pure values (arithmetic, conversions, OpPhi, OpLoad of inputs and of the uav's image):
+static bool
+IsRootInstruction(SpvOp op)
+{
+    switch (op) {
+    case SpvOpLabel:
+    case SpvOpBranch:
+    case SpvOpBranchConditional:
+    case SpvOpSelectionMerge:
+    case SpvOpLoopMerge:
+    case SpvOpReturn:
+    case SpvOpImageWrite:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// The id operands of an instruction (and its result type and id), without its literals:
+static void
+PushIdOperands(const uint32_t *p, Array<SpvId>& worklist)
+{
+    uint numIds = (p[0] >> 16) - 1;
+    switch (SpvOp(p[0] & 0xFFFFu)) {
+    case SpvOpCompositeExtract: numIds = 3; break; // then the indices
+    case SpvOpVectorShuffle: numIds = 4; break; // then the components
+    case SpvOpSelectionMerge: numIds = 1; break; // then the control mask
+    case SpvOpLoopMerge: numIds = 2; break;
+    case SpvOpExtInst: // the instruction number is between the set and the operands
+        worklist.push_n(p + 5, numIds - 4);
+        numIds = 3;
+        break;
+    default:
+        break;
+    }
+    worklist.push_n(p + 1, numIds);
+}
+
+/*
+    Dead code elimination over the function body, mark and sweep rather than one backward pass,
+    so the values only the header phis of a loop use, and use each other, go too.
+
+    The roots are marked live, then the definitions of live ids through a worklist, then the pure
+    instructions with dead results are dropped. live ends up with every id the remaining code
+    uses, constants, types and the builtin loads (which aren't in code) included, so what the
+    module declares can be cut down to that too.
+**/
+static void
+EliminateDeadCode(Array<uint32_t>& code, SpvId bound, Array<uint8_t>& live)
+{
+    Array<uint32_t> defs; // by id, 1 + word index in code of the pure instruction defining it
+    defs.reserve(bound);
+    memset(defs.set_end(bound) - bound, 0, bound * sizeof(uint32_t));
+    live.reserve(bound);
+    memset(live.set_end(bound) - bound, 0, bound);
+
+    Array<SpvId> worklist;
+    uint32_t *const pCode = code.data();
+    for (uint i = 0; i < code.size(); i += pCode[i] >> 16) {
+        if (IsRootInstruction(SpvOp(pCode[i] & 0xFFFFu))) {
+            PushIdOperands(pCode + i, worklist);
+        }
+        else {
+            defs[pCode[i + 2]] = i + 1;
+        }
+    }
+    while (!worklist.is_empty()) {
+        SpvId const id = worklist.pop();
+        if (!live[id]) {
+            live[id] = 1;
+            if (uint32_t const def = defs[id]) {
+                PushIdOperands(pCode + def - 1, worklist);
+            }
+        }
+    }
 
-                SpvId dstValueId = EmitBinOp(m, code, op, dstTypeSpvId,
-                                             srcValueIds[0], srcValueIds[1]);
+    uint32_t *pOut = pCode;
+    for (const uint32_t *p = pCode, *const pEnd = code.end(); p != pEnd;) {
+        uint const numWords = p[0] >> 16;
+        if (IsRootInstruction(SpvOp(p[0] & 0xFFFFu)) || live[p[2]]) {
+            memmove(pOut, p, numWords * sizeof(uint32_t));
+            pOut += numWords;
+        }
+        p += numWords;
+    }
+    code.set_end(pOut - pCode);
+}
 
-                WriteVariable(env, writeCompIndex, dst, dstValueId, dstTypeSpvId);
+/*
+    The uav lowering only knows RWBuffer<uint> (or int) in u0, the one image variable there is.
+    Anything else would get that variable bound to the wrong slot or with the wrong type, so it's
+    refused. nullptr if the shader is fine, else what isn't supported.
+**/
+static const char *
+FindUnsupportedUav(const DxbcShader& shader)
+{
+    const DxbcHeaderInfo& header = shader.header;
+    if (header.uavDeclMask & ~uint64_t(1)) {
+        return "only u0 is supported";
+    }
+    if (header.uavDeclMask) {
+        const DxbcResourceDecl& uav = header.uavs[0];
+        if (uav.dim != DxbcResourceDim::buffer) {
+            return "u0 should be a typed buffer, not raw, structured or a texture";
+        }
+        for (DxbcReturnType const returnType : uav.returnTypes) {
+            if (returnType != DxbcReturnType::uint && returnType != DxbcReturnType::sint) {
+                return "u0 should be a buffer of uint or sint";
             }
         }
     }
+    for (const DxbcInstruction& instr : shader.instrs) {
+        for (uint i = 0; i < instr.numOperands; ++i) {
+            const DxbcOperand& operand = instr.operands[i];
+            if (operand.file == DxbcFile::uav && (operand.slotInFile != 0 || !header.uavDeclMask)) {
+                return "uav operand that isn't declared";
+            }
+        }
+    }
+    return nullptr;
 }
 
-void DxbcTextToSpirvFile(const char *szDxbcText, const char *filename, SpvImageFormat uav0Format = SpvImageFormatUnknown) // okay if write-only
+// Lowers an already decoded shader, from either front-end, the shader can be lowered again afterwards:
+bool DxbcShaderToSpirvFile(const DxbcShader& shader, const char *filename, SpvImageFormat uav0Format = SpvImageFormatUnknown)
 {
-    DxbcTextScanner scanner = { szDxbcText };
-    
+    if (const char *const message = FindUnsupportedUav(shader)) {
+        printf("unsupported uav: %s\n", message);
+        return false;
+    }
+
     Module m;
-    // assuming just a single func and basic block now...
+    m.dxbcHeaderInfo = shader.header;
+    m.dxbcImmediates = shader.immediates.data();
+
+    // assuming just a single func now, basicblock is the entry block and the ones after it
     BasicBlock basicblock = {};
     basicblock.spvId = m.AllocId();
     Function fn = {};
+    fn.currentBlockId = basicblock.spvId;
 
-    if (DxbcText_ScanHeader(&scanner, &m.dxbcHeaderInfo) != DxbcTextScanResult::Okay) {
-        puts("bad dxbc header");
-        return;
-    }
-    
     if (m.dxbcHeaderInfo.vThreadID_usedMask) {
         m.ptr_vThreadID_id = m.AllocId();
     }
     if (m.dxbcHeaderInfo.vThreadIDInGroupFlattened) {
         m.ptr_vThreadIDInGroupFlattened_id = m.AllocId();
     }
-    if (m.dxbcHeaderInfo.uavDeclMask) {
+    if (m.dxbcHeaderInfo.uavDeclMask & 1u) {
         m.ptr_uav_ids[0] = m.AllocId();
         m.uav_image_type_ids[0] = m.AllocId(); // XXX: reuse
     }
 
-    DxbcInstruction dxbcInstr;
-    dxbcInstr.tag = DxbcInstrTag::ret;
-    Codegen(m, fn, basicblock.code, &scanner, dxbcInstr);
-    if (dxbcInstr.tag != DxbcInstrTag::ret) {
+    const DxbcInstruction *const pEnd = shader.instrs.end();
+    VariableEnv env;
+    const DxbcInstruction *const pLast = Codegen(m, fn, basicblock.code, env, shader.instrs.begin(), pEnd);
+    if (pLast == pEnd || pLast->tag != DxbcInstrTag::ret) {
         puts("should end in ret");
-        return;
+        return false;
+    }
+
+    Array<uint8_t> live;
+    EliminateDeadCode(basicblock.code, m.GetBound(), live);
+    // The builtin loads at the start of the function, and their variables, only if still used:
+    for (uint comp = 0; comp < 3; ++comp) {
+        SpvId& id = fn.vThreadID_c_id[comp];
+        if (id && !live[id]) {
+            id = 0;
+        }
+        if (id) {
+            live[fn.vThreadID_xyx_id] = 1;
+        }
+    }
+    if (fn.vThreadID_xyx_id && !live[fn.vThreadID_xyx_id]) {
+        fn.vThreadID_xyx_id = 0;
+    }
+    if (!fn.vThreadID_xyx_id) {
+        m.ptr_vThreadID_id = 0;
+    }
+    if (fn.vThreadIDInGroupFlattened_id && !live[fn.vThreadIDInGroupFlattened_id]) {
+        fn.vThreadIDInGroupFlattened_id = 0;
+    }
+    if (!fn.vThreadIDInGroupFlattened_id) {
+        m.ptr_vThreadIDInGroupFlattened_id = 0;
+    }
+    // The types the variables below point to:
+    if (m.ptr_vThreadID_id) {
+        live[StaticSpvId_TypeV3GenInt32] = 1;
+    }
+    if (m.ptr_vThreadIDInGroupFlattened_id || m.ptr_uav_ids[0]) {
+        live[StaticSpvId_TypeGenInt32] = 1;
     }
 
     Array<uint32_t> code;
@@ -887,19 +2131,46 @@ void DxbcTextToSpirvFile(const char *szDxbcText, const char *filename, SpvImageF
     code.push_initlist({ SpvOpTypeVoid | 2 << 16, StaticSpvId_TypeVoid });
     code.push_initlist({ SpvOpTypeFunction | 3 << 16, StaticSpvId_TypeVoidFunction, StaticSpvId_TypeVoid });
 
-    code.push_initlist({ SpvOpTypeInt | 4 << 16, StaticSpvId_TypeGenInt32, 32, 0 });
-    code.push_initlist({ SpvOpTypeVector | 4 << 16, StaticSpvId_TypeV2GenInt32, StaticSpvId_TypeGenInt32, 2 });
-    code.push_initlist({ SpvOpTypeVector | 4 << 16, StaticSpvId_TypeV3GenInt32, StaticSpvId_TypeGenInt32, 3 });
-    code.push_initlist({ SpvOpTypeVector | 4 << 16, StaticSpvId_TypeV4GenInt32, StaticSpvId_TypeGenInt32, 4 });
-    
-    code.push_initlist({ SpvOpTypeFloat | 3 << 16, StaticSpvId_TypeFloat32, 32 });
-    //code.push_initlist({ SpvOpTypeVector | 4 << 16, StaticSpvId_TypeV2Float32, StaticSpvId_TypeFloat32, 2 });
-    //code.push_initlist({ SpvOpTypeVector | 4 << 16, StaticSpvId_TypeV3Float32, StaticSpvId_TypeFloat32, 3 });
-    code.push_initlist({ SpvOpTypeVector | 4 << 16, StaticSpvId_TypeV4Float32, StaticSpvId_TypeFloat32, 4 });
-
-    code.push_initlist({ SpvOpTypeBool | 2 << 16, StaticSpvId_TypeBool });
+    // Only the constants and types that are used, the components of a composite constant are
+    // scalar constants and the component type of a vector type is a scalar type:
+    for (const ConstantsMapComposite::Element& e : m.compositeConstants) {
+        if (live[e.id]) {
+            for (uint i = 0; i <= (e.key.typeId & 3u); ++i) {
+                live[e.key.componentIds[i]] = 1;
+            }
+            live[e.key.typeId] = 1;
+        }
+    }
+    for (const ConstantsMapScaler32::Element& e : m.scalarConstants) {
+        if (live[e.id]) {
+            live[e.key.typeId] = 1;
+        }
+    }
+    for (SpvId const scalarTypeId : { StaticSpvId_TypeGenInt32, StaticSpvId_TypeFloat32, StaticSpvId_TypeBool }) {
+        for (uint n = 1; n < 4; ++n) {
+            live[scalarTypeId] |= live[scalarTypeId + n];
+        }
+        if (!live[scalarTypeId]) {
+            continue;
+        }
+        if (scalarTypeId == StaticSpvId_TypeGenInt32) {
+            code.push_initlist({ SpvOpTypeInt | 4 << 16, scalarTypeId, 32, 0 });
+        }
+        else if (scalarTypeId == StaticSpvId_TypeFloat32) {
+            code.push_initlist({ SpvOpTypeFloat | 3 << 16, scalarTypeId, 32 });
+        }
+        else {
+            code.push_initlist({ SpvOpTypeBool | 2 << 16, scalarTypeId });
+        }
+        for (uint n = 1; n < 4; ++n) {
+            if (live[scalarTypeId + n]) {
+                code.push_initlist({ SpvOpTypeVector | 4 << 16, scalarTypeId + n, scalarTypeId, n + 1 });
+            }
+        }
+    }
 
-    EmitScalarConstants(code, m.gint32Constants, StaticSpvId_TypeGenInt32);
+    EmitScalarConstants(code, m.scalarConstants, live);
+    EmitCompositeConstants(code, m.compositeConstants, live);
 
     if (m.ptr_vThreadID_id) {
         const SpvStorageClass storageClass = SpvStorageClassInput;
@@ -952,12 +2223,14 @@ void DxbcTextToSpirvFile(const char *szDxbcText, const char *filename, SpvImageF
 
     code[3] = m.GetBound();
 
+    bool written = false;
     {
         printf("\nwriting spirv to [file]=[%s]\n", filename);
         FILE *fp = fopen(filename, "wb");
         if (fp) {
             const size_t nbytes = code.size() * sizeof(uint32_t);
-            if (fwrite(code.data(), 1, code.size() * sizeof(uint32_t), fp) != nbytes) {
+            written = fwrite(code.data(), 1, code.size() * sizeof(uint32_t), fp) == nbytes;
+            if (!written) {
                 perror("fwrite");
             }
             fclose(fp);
@@ -1003,8 +2276,161 @@ void DxbcTextToSpirvFile(const char *szDxbcText, const char *filename, SpvImageF
         }
     }
 #endif
+    return written;
+}
+
+bool DxbcTextToSpirvFile(const char *pText, const char *pTextEnd, const char *filename, SpvImageFormat uav0Format = SpvImageFormatUnknown) // okay if write-only
+{
+    DxbcTextScanner scanner;
+    DxbcText_Init(&scanner, pText, pTextEnd);
+
+    DxbcShader shader;
+    DxbcTextScanResult const result = DxbcText_DecodeParallel(&scanner, &shader, 0);
+    if (result != DxbcTextScanResult::Okay) {
+        DxbcTextLocation const loc = DxbcText_GetErrorLocation(&scanner);
+        printf("bad dxbc text :( line %u, column %u: %s (err=%d)\n", loc.line, loc.column, scanner.errorMessage, int(result));
+        return false;
+    }
+    return DxbcShaderToSpirvFile(shader, filename, uav0Format);
+}
+
+bool DxbcTextToSpirvFile(const char *szDxbcText, const char *filename, SpvImageFormat uav0Format = SpvImageFormatUnknown)
+{
+    return DxbcTextToSpirvFile(szDxbcText, szDxbcText + strlen(szDxbcText), filename, uav0Format);
+}
+
+// Reads a listing in chunks as it arrives (stdin, a pipe...), never holding more than a chunk and a line of text:
+bool DxbcTextStreamToSpirvFile(FILE *fp, const char *filename, SpvImageFormat uav0Format = SpvImageFormatUnknown)
+{
+    DxbcTextStream stream;
+    DxbcText_StreamInit(&stream);
+
+    DxbcShader shader;
+    DxbcTextScanResult result = DxbcTextScanResult::Okay;
+    static char chunk[64 * 1024];
+    size_t numRead;
+    while (result == DxbcTextScanResult::Okay && (numRead = fread(chunk, 1, sizeof chunk, fp)) != 0) {
+        result = DxbcText_StreamFeed(&stream, chunk, chunk + numRead, &shader.instrs);
+    }
+    if (ferror(fp)) {
+        perror("read");
+        return false;
+    }
+    if (result == DxbcTextScanResult::Okay) {
+        result = DxbcText_StreamFinish(&stream, &shader.instrs);
+    }
+    if (result != DxbcTextScanResult::Okay) {
+        DxbcTextLocation const loc = DxbcText_StreamGetErrorLocation(&stream);
+        printf("bad dxbc text :( line %u, column %u: %s (err=%d)\n", loc.line, loc.column, stream.scanner.errorMessage, int(result));
+        return false;
+    }
+    shader.header = stream.header;
+    // the stream owns the immediates, copy them next to the instructions:
+    if (!stream.immediates.is_empty()) {
+        shader.immediates.push_n(stream.immediates.data(), stream.immediates.size());
+    }
+    return DxbcShaderToSpirvFile(shader, filename, uav0Format);
 }
 
+// pBytes is a whole DXBC container (what D3DCompile returns), must be 4-byte aligned.
+bool DxbcBinaryToSpirvFile(const void *pBytes, size_t numBytes, const char *filename, SpvImageFormat uav0Format = SpvImageFormatUnknown)
+{
+    DxbcBinaryScanner scanner;
+    DxbcBinaryScanResult result = DxbcBinary_InitFromContainer(&scanner, pBytes, numBytes);
+    if (result != DxbcBinaryScanResult::Okay) {
+        printf("bad dxbc container, err=%d\n", int(result));
+        return false;
+    }
+
+    DxbcShader shader;
+    result = DxbcBinary_Decode(&scanner, &shader);
+    if (result != DxbcBinaryScanResult::Okay) {
+        if (!scanner.pErrorToken) {
+            printf("bad dxbc tokens :( err=%d\n", int(result));
+        }
+        else if (scanner.pErrorToken == scanner.pEnd) {
+            printf("bad dxbc tokens :( at the end: %s (err=%d)\n",
+                   scanner.errorMessage ? scanner.errorMessage : "truncated", int(result));
+        }
+        else {
+            printf("bad dxbc tokens :( byte %u, opcode %u: %s (err=%d)\n",
+                   uint((const char *)scanner.pErrorToken - (const char *)pBytes), *scanner.pErrorToken & 0x7ff,
+                   scanner.errorMessage ? scanner.errorMessage : "bad instruction", int(result));
+        }
+        return false;
+    }
+    return DxbcShaderToSpirvFile(shader, filename, uav0Format);
+}
+
+// Picks the front-end: a DXBC container starts with "DXBC", anything else is taken to be an fxc listing.
+bool DxbcBytesToSpirvFile(const char *pBegin, const char *pEnd, const char *filename, SpvImageFormat uav0Format = SpvImageFormatUnknown)
+{
+    size_t const numBytes = size_t(pEnd - pBegin);
+    if (numBytes >= 4 && memcmp(pBegin, "DXBC", 4) == 0) {
+        return DxbcBinaryToSpirvFile(pBegin, numBytes, filename, uav0Format);
+    }
+    else {
+        return DxbcTextToSpirvFile(pBegin, pEnd, filename, uav0Format);
+    }
+}
+
+// Maps the file, "-" streams a listing from stdin.
+bool DxbcFileToSpirvFile(const char *dxbcPath, const char *filename, SpvImageFormat uav0Format = SpvImageFormatUnknown)
+{
+    if (strcmp(dxbcPath, "-") == 0) {
+        return DxbcTextStreamToSpirvFile(stdin, filename, uav0Format);
+    }
+    MappedFile file;
+    if (!MapFileReadOnly(dxbcPath, &file)) {
+        printf("can't open %s\n", dxbcPath);
+        return false;
+    }
+    // mappings are page aligned, which satisfies the 4-byte alignment of the binary scanner
+    bool const ok = DxbcBytesToSpirvFile(file.pBegin, file.pEnd, filename, uav0Format);
+    UnmapFile(&file);
+    return ok;
+}
+
+/*
+    Translates the shaders of a bundle with the given indices ("7") and ranges ("10-19"), all of them if none given,
+    to <outPrefix><index>.spv. Shaders not asked for are never touched, so workers can split a capture by range.
+    The ones that fail are printed with their index, and the result is false, the rest are still written.
+**/
+bool DxbcBundleToSpirvFiles(const char *bundlePath, const char *outPrefix, const char *const *selection, int numSelection)
+{
+    ShaderBundle bundle;
+    if (!ShaderBundle_Open(bundlePath, &bundle)) {
+        printf("can't open bundle %s\n", bundlePath);
+        return false;
+    }
+    bool ok = true;
+    for (int i = 0; i < Max(numSelection, 1); ++i) {
+        uint32_t first = 0;
+        uint32_t last = bundle.numShaders - 1;
+        if (numSelection) {
+            char *pRest;
+            first = last = uint32_t(strtoul(selection[i], &pRest, 10));
+            if (*pRest == '-') {
+                last = uint32_t(strtoul(pRest + 1, &pRest, 10));
+            }
+            if (*pRest || first > last || last >= bundle.numShaders) {
+                printf("bad shader index or range %s, the bundle has %u shaders\n", selection[i], bundle.numShaders);
+                ok = false;
+                continue;
+            }
+        }
+        for (uint32_t index = first; index <= last && index < bundle.numShaders; ++index) {
+            char filename[1024];
+            snprintf(filename, sizeof filename, "%s%u.spv", outPrefix, index);
+            if (!DxbcBytesToSpirvFile(ShaderBundle_ShaderBegin(&bundle, index), ShaderBundle_ShaderEnd(&bundle, index), filename)) {
+                printf("shader %u of %s failed, %s not written\n", index, bundlePath, filename);
+                ok = false;
+            }
+        }
+    }
+    ShaderBundle_Close(&bundle);
+    return ok;
+}
 
 /* Some interseting tools:
 
@@ -1019,10 +2445,57 @@ C:\VulkanSDK\1.2.148.1\Bin\dxc.exe -spirv some_file.hlsl -T cs_5_0 -E main -O3
 set PATH=%PATH%;C:\VulkanSDK\1.2.176.1\Bin
 
 **/
-int main(void)
+int main(int argc, char **argv)
 {
+    // dxbc_to_spirv --pack out.bundle in.{txt,dxbc}...
+    if (argc > 2 && strcmp(argv[1], "--pack") == 0) {
+        return !ShaderBundle_Write(argv[2], argv + 3, uint32_t(argc - 3));
+    }
+    // dxbc_to_spirv --bundle in.bundle outPrefix [index or first-last]...
+    if (argc > 3 && strcmp(argv[1], "--bundle") == 0) {
+        return !DxbcBundleToSpirvFiles(argv[2], argv[3], argv + 4, argc - 4);
+    }
+    // dxbc_to_spirv in.{txt,dxbc} out.spv [in2 out2.spv ...], in can be - for a listing on stdin
+    if (argc > 1) {
+        if (argc % 2 != 1) {
+            puts("usage: dxbc_to_spirv in.{txt,dxbc} out.spv [more pairs...]\n"
+                 "       dxbc_to_spirv --pack out.bundle in.{txt,dxbc}...\n"
+                 "       dxbc_to_spirv --bundle in.bundle outPrefix [index or first-last]...");
+            return 1;
+        }
+        int numFailed = 0;
+        for (int i = 1; i < argc; i += 2) {
+            numFailed += !DxbcFileToSpirvFile(argv[i], argv[i + 1]);
+        }
+        return numFailed != 0;
+    }
+
 #if 1
-    static const char LogicalOrDxbcText[] = R"(cs_5_0
+    // whole fxc /Fc output, comments and all:
+    static const char LogicalOrDxbcText[] = R"(//
+// Generated by Microsoft (R) HLSL Shader Compiler 10.1
+//
+//
+// Resource Bindings:
+//
+// Name                                 Type  Format         Dim      HLSL Bind  Count
+// ------------------------------ ---------- ------- ----------- -------------- ------
+// uav                                   UAV    uint         buf             u0      1 
+//
+//
+//
+// Input signature:
+//
+// Name                 Index   Mask Register SysValue  Format   Used
+// -------------------- ----- ------ -------- -------- ------- ------
+// no Input
+//
+// Output signature:
+//
+// Name                 Index   Mask Register SysValue  Format   Used
+// -------------------- ----- ------ -------- -------- ------- ------
+// no Output
+cs_5_0
 dcl_globalFlags refactoringAllowed
 dcl_uav_typed_buffer (uint,uint,uint,uint) u0
 dcl_input vThreadID.x
@@ -1036,7 +2509,8 @@ movc r0.x, r0.x, l(1000), l(2000)
 iadd r0.x, r0.x, vThreadID.x
 xor r0.x, r0.z, r0.x
 store_uav_typed u0.xyzw, vThreadID.xxxx, r0.xxxx
-ret
+ret 
+// Approximately 9 instruction slots used
 )";
 
     DxbcTextToSpirvFile(LogicalOrDxbcText, "LogicalOr.spv");
@@ -1128,6 +2602,226 @@ ret
     DxbcTextToSpirvFile(IfElseDxbcText, "branch.spv");
 #endif
 
+#if 1
+    static const char LoopDxbcText[] = R"(cs_5_0
+dcl_globalFlags refactoringAllowed
+dcl_uav_typed_buffer (uint,uint,uint,uint) u0
+dcl_input vThreadIDInGroupFlattened
+dcl_input vThreadID.xy
+dcl_temps 2
+dcl_thread_group 8, 4, 1
+mov r0.x, l(0)
+mov r0.y, l(0)
+loop
+  uge r0.z, r0.y, vThreadID.x
+  breakc_nz r0.z
+  and r0.w, r0.y, l(1)
+  iadd r0.y, r0.y, l(1)
+  if_nz r0.w
+    continue
+  endif
+  mov r1.y, l(0)
+  loop
+    iadd r0.x, r0.x, r0.y
+    iadd r1.y, r1.y, l(1)
+    uge r1.z, r1.y, vThreadID.y
+    continuec_z r1.z
+    break
+  endloop
+  ieq r1.x, r0.x, l(9)
+  if_nz r1.x
+    xor r0.x, r0.x, l(1000)
+    break
+  endif
+endloop
+store_uav_typed u0.xyzw, vThreadIDInGroupFlattened.xxxx, r0.xxxx
+ret
+)";
+
+    DxbcTextToSpirvFile(LoopDxbcText, "loop.spv");
+#endif
+
+#if 1
+    // float immediates, typed by what reads them:
+    static const char FltImmDxbcText[] = R"(cs_5_0
+dcl_globalFlags refactoringAllowed
+dcl_uav_typed_buffer (uint,uint,uint,uint) u0
+dcl_input vThreadID.x
+dcl_temps 1
+dcl_thread_group 16, 1, 1
+and r0.x, vThreadID.x, l(1)
+movc r0.y, r0.x, l(2.500000), l(-4.000000)
+add r0.z, r0.y, l(1.500000)
+ult r0.x, vThreadID.x, l(8)
+movc r0.w, r0.x, r0.z, l(0.250000)
+add r0.w, r0.w, l(-0.250000)
+if_nz r0.w
+  add r0.w, r0.w, l(0.500000)
+endif
+store_uav_typed u0.xyzw, vThreadID.xxxx, r0.wwww
+ret
+)";
+
+    DxbcTextToSpirvFile(FltImmDxbcText, "FltImm.spv");
+#endif
+
+#if 1
+    // whole-vector ops, lowered as vector instructions:
+    static const char VecDxbcText[] = R"(cs_5_0
+dcl_globalFlags refactoringAllowed
+dcl_uav_typed_buffer (uint,uint,uint,uint) u0
+dcl_input vThreadIDInGroupFlattened
+dcl_input vThreadID.xyz
+dcl_temps 4
+dcl_thread_group 4, 2, 2
+imad r0.xyz, vThreadID.xyzx, l(3, 5, 7, 0), l(1, 2, 3, 0)
+ishl r1.xyz, r0.xyzx, l(1, 2, 3, 0)
+iadd r0.xyz, r0.xyzx, r1.xyzx
+xor r1.xyz, r0.yzxy, r0.xyzx
+and r2.xyz, r1.xyzx, l(255, 255, 255, 0)
+ult r3.xyz, r2.xyzx, l(128, 64, 32, 0)
+movc r2.xyz, r3.xyzx, r2.xyzx, l(7, 7, 7, 0)
+if_nz r3.y
+  iadd r2.xyz, r2.xyzx, vThreadID.xyzx
+endif
+imad r1.xyz, r2.xyzx, r2.yzxy, -r0.xyzx
+or r1.xyz, r1.xyzx, r0.zxyz
+iadd r2.xy, r1.xyxx, r1.zzzz
+iadd r2.x, r2.x, r2.y
+store_uav_typed u0.xyzw, vThreadIDInGroupFlattened.xxxx, r2.xxxx
+ret
+)";
+
+    DxbcTextToSpirvFile(VecDxbcText, "Vec.spv");
+#endif
+
+#if 1
+    // the same compare and select on a copy, value numbering keeps one of each:
+    static const char LvnDxbcText[] = R"(cs_5_0
+dcl_globalFlags refactoringAllowed
+dcl_uav_typed_buffer (uint,uint,uint,uint) u0
+dcl_input vThreadID.x
+dcl_temps 3
+dcl_thread_group 16, 1, 1
+and r0.x, vThreadID.x, l(3)
+mov r1.x, r0.x
+ieq r2.x, r0.x, l(2)
+ieq r2.y, l(2), r1.x
+movc r0.y, r2.x, l(7), l(9)
+movc r0.z, r2.y, l(7), l(9)
+iadd r0.w, r0.y, r0.z
+store_uav_typed u0.xyzw, vThreadID.xxxx, r0.wwww
+ret
+)";
+
+    DxbcTextToSpirvFile(LvnDxbcText, "Lvn.spv");
+#endif
+
+#if 1
+    // baked in constants, all of it but the last iadd folds:
+    static const char FoldDxbcText[] = R"(cs_5_0
+dcl_globalFlags refactoringAllowed
+dcl_uav_typed_buffer (uint,uint,uint,uint) u0
+dcl_input vThreadID.x
+dcl_temps 2
+dcl_thread_group 16, 1, 1
+mov r0.x, l(5)
+ishl r0.y, r0.x, l(35)
+iadd r0.z, r0.y, l(-8)
+ieq r0.w, r0.z, l(32)
+and r1.x, r0.w, l(7)
+movc r1.y, r0.w, r1.x, l(100)
+iadd r1.zw, -r1.yyyy, l(0, 0, 10, 20)
+iadd r1.z, r1.z, r1.w
+iadd r1.z, r1.z, vThreadID.x
+store_uav_typed u0.xyzw, vThreadID.xxxx, r1.zzzz
+ret
+)";
+
+    DxbcTextToSpirvFile(FoldDxbcText, "Fold.spv");
+#endif
+
+#if 1
+    // movc of a bool temp and an int immediate, the select is int, l(31) mustn't become true (-1):
+    static const char MovcBoolDxbcText[] = R"(cs_5_0
+dcl_globalFlags refactoringAllowed
+dcl_uav_typed_buffer (uint,uint,uint,uint) u0
+dcl_input vThreadID.xy
+dcl_temps 4
+dcl_thread_group 4, 4, 1
+ieq r1.x, vThreadID.x, l(2)
+movc r3.x, vThreadID.y, l(31), r1.x
+movc r3.y, vThreadID.y, r1.x, l(31)
+iadd r3.z, r3.x, r3.y
+imad r2.x, vThreadID.y, l(4), vThreadID.x
+store_uav_typed u0.xyzw, r2.xxxx, r3.zzzz
+ret
+)";
+
+    DxbcTextToSpirvFile(MovcBoolDxbcText, "MovcBool.spv");
+#endif
+
+#if 1
+    // the same shader as a compiled container, hand-assembled, must give the same SPIR-V as the text:
+    static const char ShexDxbcText[] = R"(cs_5_0
+dcl_globalFlags refactoringAllowed
+dcl_uav_typed_buffer (uint,uint,uint,uint) u0
+dcl_input vThreadID.x
+dcl_temps 2
+dcl_thread_group 16, 1, 1
+mov r0.x, l(0)
+mov r0.y, l(0)
+loop
+  uge r0.z, r0.x, vThreadID.x
+  breakc_nz r0.z
+  iadd r0.y, r0.y, -r0.x
+  iadd r0.x, r0.x, l(1)
+endloop
+and r0.z, vThreadID.x, l(1)
+if_nz r0.z
+  iadd r1.x, -r0.y, l(1000)
+else
+  ult r0.w, vThreadID.x, l(8)
+  movc r1.y, r0.w, l(2.500000), l(-4.000000)
+  add r1.x, -|r1.y|, l(10.000000)
+endif
+store_uav_typed u0.xyzw, vThreadID.xxxx, r1.xxxx
+ret
+)";
+    static const uint32_t ShexDxbcContainer[] = {
+        0x43425844, 0x00000000, 0x00000000, 0x00000000, 0x00000000, // "DXBC", checksum (not checked)
+        0x00000001, 0x000001bc, 0x00000001, 0x00000024, // 1, total size, 1 chunk at byte 36
+        0x58454853, 0x00000190, // "SHEX", chunk size
+        0x00050050, 0x00000064, // cs_5_0, length in tokens
+        0x0100086a, // dcl_globalFlags refactoringAllowed
+        0x0400089c, 0x0011e000, 0x00000000, 0x00004444, // dcl_uav_typed_buffer (uint,uint,uint,uint) u0
+        0x0200005f, 0x00020012, // dcl_input vThreadID.x
+        0x02000068, 0x00000002, // dcl_temps 2
+        0x0400009b, 0x00000010, 0x00000001, 0x00000001, // dcl_thread_group 16, 1, 1
+        0x05000036, 0x00100012, 0x00000000, 0x00004001, 0x00000000, // mov r0.x, l(0)
+        0x05000036, 0x00100022, 0x00000000, 0x00004001, 0x00000000, // mov r0.y, l(0)
+        0x01000030, // loop
+        0x06000050, 0x00100042, 0x00000000, 0x00100006, 0x00000000, 0x00020006, // uge r0.z, r0.x, vThreadID.x
+        0x03040003, 0x0010002a, 0x00000000, // breakc_nz r0.z
+        0x0800001e, 0x00100022, 0x00000000, 0x00100556, 0x00000000, 0x80100006, 0x00000041, 0x00000000, // iadd r0.y, r0.y, -r0.x
+        0x0700001e, 0x00100012, 0x00000000, 0x00100006, 0x00000000, 0x00004001, 0x00000001, // iadd r0.x, r0.x, l(1)
+        0x01000016, // endloop
+        0x06000001, 0x00100042, 0x00000000, 0x00020006, 0x00004001, 0x00000001, // and r0.z, vThreadID.x, l(1)
+        0x0304001f, 0x0010002a, 0x00000000, // if_nz r0.z
+        0x0800001e, 0x00100012, 0x00000001, 0x80100556, 0x00000041, 0x00000000, 0x00004001, 0x000003e8, // iadd r1.x, -r0.y, l(1000)
+        0x01000012, // else
+        0x0600004f, 0x00100082, 0x00000000, 0x00020006, 0x00004001, 0x00000008, // ult r0.w, vThreadID.x, l(8)
+        0x09000037, 0x00100022, 0x00000001, 0x00100ff6, 0x00000000, 0x00004001, 0x40200000, 0x00004001, 0xc0800000, // movc r1.y, r0.w, l(2.500000), l(-4.000000)
+        0x08000000, 0x00100012, 0x00000001, 0x80100556, 0x000000c1, 0x00000001, 0x00004001, 0x41200000, // add r1.x, -|r1.y|, l(10.000000)
+        0x01000015, // endif
+        0x060000a4, 0x0011e0f2, 0x00000000, 0x00020006, 0x00100006, 0x00000001, // store_uav_typed u0.xyzw, vThreadID.xxxx, r1.xxxx
+        0x0100003e, // ret
+    };
+
+    DxbcTextToSpirvFile(ShexDxbcText, "ShexText.spv");
+    DxbcBinaryToSpirvFile(ShexDxbcContainer, sizeof ShexDxbcContainer, "Shex.spv");
+#endif
+
 
     return 0;
 }
\ No newline at end of file